@@ -1,21 +1,47 @@
+#include <glob.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <string>
 #include <vector>
 
+#include "include/batch.h"
 #include "include/caesar_dec.h"
 #include "include/caesar_enc.h"
+#include "include/file_io.h"
+#include "include/kernels.h"
+#include "include/pool.h"
+#include "include/rng.h"
+#include "include/server.h"
+#include "include/stats.h"
 #include "include/subst_dec.h"
 #include "include/subst_enc.h"
 #include "utils.h"
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 // Initialize random number generator in .cpp file for ODR reasons
-std::mt19937 Random::rng;
+thread_local std::mt19937 Random::rng;
 
 const string ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 
@@ -24,41 +50,108 @@ const string ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
  */
 void printMenu();
 
-vector<char> decryptSubstCipher(const QuadgramScorer& scorer,
-                                const string& ciphertext);
+/**
+ * What main was asked to do: the solver settings, and which mode to run in
+ * instead of the menu. Only main sees these; solves only get `solver`.
+ */
+struct CliOptions {
+  SolverOptions solver;
+
+  // Print `solverStats()` as JSON to cerr after every decryption
+  bool statsJson = false;
+
+  // Answer requests with `serveCommand` instead of showing the menu, on
+  // stdin and stdout or on the Unix socket at `servePath` if it's set
+  bool serve = false;
+  string servePath;
+
+  // Decrypt `batchInputs` into the directory `batchOutput` with
+  // `batchCommand` instead of showing the menu, if `batchOutput` is set
+  string batchOutput;
+  vector<string> batchInputs;
+};
 
-int main() {
+/**
+ * Read settings from the environment and the command line. Flags win over
+ * environment variables.
+ *
+ *   --threads=N / CIPHERS_THREADS=N  run restarts on N threads (0 = all cores)
+ *   --table=F / CIPHERS_TABLE=F      quadgram table storage: double, float,
+ *                                    int16 or uint8
+ *   --engine=E / CIPHERS_ENGINE=E    solver engine: hill, anneal, best or
+ *                                    first
+ *   --restarts=N                     solver restarts (0 = engine default)
+ *   --anneal-iterations=N            swaps per annealing restart
+ *   --temperature=START:END          annealing temperatures per quadgram
+ *   --warm-start[=N]                 start from the letter-frequency key,
+ *                                    perturbed by N swaps after restart 0
+ *   --scoring=M                      quadgram layout: auto, positions or
+ *                                    histogram
+ *   --sample=N                       solve longer ciphertexts on N sampled
+ *                                    letters, then refine on the full text
+ *   --rng=G                          solver generator: philox, xoshiro or
+ *                                    mt19937
+ *   --time-limit=S                   stop solving after S seconds and keep
+ *                                    the best key so far
+ *   --max-swaps=N                    stop solving once the restarts, in
+ *                                    order, have proposed N swaps
+ *   --agree=K                        stop once K restarts found the best key
+ *   --score-cache=BITS               share a cache of 2^BITS key scores
+ *                                    between restarts (default 16, 0 = off,
+ *                                    at most 30)
+ *   --batch=DIR FILE...              decrypt every FILE (globs allowed)
+ *                                    into DIR instead of showing the menu
+ *   --serve[=PATH]                   answer JSON requests on stdin and
+ *                                    stdout, or on a Unix socket at PATH,
+ *                                    instead of showing the menu
+ *   --stats=json                     print solver stats to cerr after every
+ *                                    decryption
+ *
+ * Throws `invalid_argument` if there are FILE arguments without `--batch`, if
+ * a number doesn't parse or is out of range, or if `--score-cache` isn't 0
+ * to 30.
+ */
+CliOptions parseCliOptions(int argc, char* argv[]);
+
+/**
+ * With `--stats=json`, print the last decryption's stats to cerr as one line
+ * of JSON.
+ */
+void printStatsJson(const CliOptions& cli);
+
+int main(int argc, char* argv[]) {
   Random::seed(time(NULL));
   string command;
 
-  // Load the dictionary from file
-  vector<string> dictionary;
-  ifstream dict("dictionary.txt");
-  string word;
-  while (getline(dict, word)) {
-    dictionary.push_back(word);
+  CliOptions cli;
+  try {
+    cli = parseCliOptions(argc, argv);
+  } catch (const invalid_argument& e) {
+    cerr << e.what() << endl;
+    return 1;
   }
-  dict.close();
+  const SolverOptions& options = cli.solver;
 
-  vector<string> quadgrams;
-  vector<int> counts;
+  CIPHERS_STAT(auto loadStart = chrono::steady_clock::now());
 
-  ifstream quadFile("english_quadgrams.txt");  // read quad scores file
+  // Load the dictionary from file, and index it once for every command
+  Dictionary dictionary = Dictionary::load("dictionary.txt");
 
-  string quad;  // read each quad
-  while (getline(quadFile, quad)) {
-    size_t comma = quad.find(',');
-    if (comma != string::npos) {
-      quadgrams.push_back(
-          quad.substr(0, comma));  // extract the string, which is the beginning
-                                   // of the string till the comma
-      counts.push_back(stoi(
-          quad.substr(comma + 1)));  // get the count that's after the comma
-    }
-  }
-  quadFile.close();
+  // Map the precompiled table if `make quadgrams` has built it, otherwise
+  // parse the CSV
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  scorer.setFormat(options.table);
+  CIPHERS_STAT(solverStats().loadSeconds =
+                   chrono::duration<double>(chrono::steady_clock::now() -
+                                            loadStart)
+                       .count());
 
-  QuadgramScorer scorer(quadgrams, counts);
+  if (cli.serve) {
+    return serveCommand(dictionary, scorer, options, cli.servePath);
+  }
+  if (!cli.batchOutput.empty()) {
+    return batchCommand(scorer, cli.batchInputs, cli.batchOutput, options);
+  }
 
   cout << "Welcome to Ciphers!" << endl;
   cout << "-------------------" << endl;
@@ -94,7 +187,8 @@ int main() {
     }
 
     if (command == "S" || command == "s") {
-      decryptSubstCipherCommand(scorer);
+      decryptSubstCipherCommand(scorer, options);
+      printStatsJson(cli);
     }
 
     if (command == "A" || command == "a") {
@@ -102,31 +196,24 @@ int main() {
     }
 
     if (command == "F" || command == "f") {
-      string inputFile;
-      cout << "Enter input file name: ";
-      getline(cin, inputFile);
-      ifstream inFile(inputFile);
+      decryptSubstFileCommand(scorer, options);
+      printStatsJson(cli);
+    }
 
-      string outputFile;
-      cout << "Enter output file name: ";
-      getline(cin, outputFile);
+    if (command == "B" || command == "b") {
+      batchDecryptCommand(scorer, options);
+    }
 
-      // Read and store each line of the file:
-      string ciphertext;
-      string line;
-      while (getline(inFile, line)) {
-        ciphertext += line + "\n";  // Keep line breaks for formatting
-      }
-      inFile.close();
+    if (command == "T" || command == "t") {
+      printSolverStatsCommand();
+    }
 
-      // Decrypt the inputted text from the file:
-      vector<char> bestKey = decryptSubstCipher(scorer, ciphertext);
-      string decryptedText = applySubstCipher(bestKey, ciphertext);
+    if (command == "G" || command == "g") {
+      caesarFileCommand();
+    }
 
-      // Lastly, write the decrypted text into the output file:
-      ofstream outFile(outputFile);
-      outFile << decryptedText;
-      outFile.close();
+    if (command == "K" || command == "k") {
+      applySubstFileCommand();
     }
 
     cout << endl;
@@ -136,6 +223,157 @@ int main() {
   return 0;
 }
 
+// Accepts 0 as "every core"
+static int parseThreadCount(const string& value) {
+  int threads = stoi(value);
+  if (threads <= 0) {
+    threads = max(1u, thread::hardware_concurrency());
+  }
+  return threads;
+}
+
+static TableFormat parseTableFormat(const string& value) {
+  if (value == "double") {
+    return TableFormat::Double;
+  } else if (value == "float") {
+    return TableFormat::Float;
+  } else if (value == "int16") {
+    return TableFormat::Int16;
+  } else if (value == "uint8") {
+    return TableFormat::Uint8;
+  }
+  cerr << "Unknown table format " << value << ", using double" << endl;
+  return TableFormat::Double;
+}
+
+static SolverEngine parseEngine(const string& value) {
+  if (value == "anneal") {
+    return SolverEngine::Anneal;
+  } else if (value == "best") {
+    return SolverEngine::BestSwap;
+  } else if (value == "first") {
+    return SolverEngine::FirstSwap;
+  } else if (value != "hill") {
+    cerr << "Unknown solver engine " << value << ", using hill" << endl;
+  }
+  return SolverEngine::HillClimb;
+}
+
+static ScoringMode parseScoringMode(const string& value) {
+  if (value == "positions") {
+    return ScoringMode::Positions;
+  } else if (value == "histogram") {
+    return ScoringMode::Histogram;
+  } else if (value != "auto") {
+    cerr << "Unknown scoring mode " << value << ", using auto" << endl;
+  }
+  return ScoringMode::Auto;
+}
+
+static RngEngine parseRngEngine(const string& value) {
+  if (value == "mt19937") {
+    return RngEngine::Mt19937;
+  } else if (value == "xoshiro") {
+    return RngEngine::Xoshiro;
+  } else if (value != "philox") {
+    cerr << "Unknown generator " << value << ", using philox" << endl;
+  }
+  return RngEngine::Philox;
+}
+
+CliOptions parseCliOptions(int argc, char* argv[]) {
+  CliOptions cli;
+  SolverOptions& options = cli.solver;
+
+  if (const char* env = getenv("CIPHERS_THREADS")) {
+    options.threads = parseThreadCount(env);
+  }
+  if (const char* env = getenv("CIPHERS_TABLE")) {
+    options.table = parseTableFormat(env);
+  }
+  if (const char* env = getenv("CIPHERS_ENGINE")) {
+    options.engine = parseEngine(env);
+  }
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    try {
+      if (arg.rfind("--threads=", 0) == 0) {
+        options.threads = parseThreadCount(arg.substr(10));
+      } else if (arg.rfind("--table=", 0) == 0) {
+        options.table = parseTableFormat(arg.substr(8));
+      } else if (arg.rfind("--engine=", 0) == 0) {
+        options.engine = parseEngine(arg.substr(9));
+      } else if (arg.rfind("--restarts=", 0) == 0) {
+        options.restarts = stoi(arg.substr(11));
+      } else if (arg.rfind("--anneal-iterations=", 0) == 0) {
+        options.annealIterations = stol(arg.substr(20));
+      } else if (arg.rfind("--scoring=", 0) == 0) {
+        options.scoring = parseScoringMode(arg.substr(10));
+      } else if (arg.rfind("--rng=", 0) == 0) {
+        options.rng = parseRngEngine(arg.substr(6));
+      } else if (arg.rfind("--time-limit=", 0) == 0) {
+        options.timeLimit = stod(arg.substr(13));
+      } else if (arg.rfind("--max-swaps=", 0) == 0) {
+        options.swapLimit = stoull(arg.substr(12));
+      } else if (arg.rfind("--agree=", 0) == 0) {
+        options.agreeRestarts = stoi(arg.substr(8));
+      } else if (arg.rfind("--score-cache=", 0) == 0) {
+        options.scoreCacheBits = stoi(arg.substr(14));
+      } else if (arg.rfind("--batch=", 0) == 0) {
+        cli.batchOutput = arg.substr(8);
+      } else if (arg.rfind("-", 0) != 0) {
+        cli.batchInputs.push_back(arg);
+      } else if (arg == "--serve") {
+        cli.serve = true;
+      } else if (arg.rfind("--serve=", 0) == 0) {
+        cli.serve = true;
+        cli.servePath = arg.substr(8);
+      } else if (arg == "--stats=json") {
+        cli.statsJson = true;
+      } else if (arg.rfind("--sample=", 0) == 0) {
+        options.sampleLetters = stoul(arg.substr(9));
+      } else if (arg == "--warm-start") {
+        options.warmStart = true;
+      } else if (arg.rfind("--warm-start=", 0) == 0) {
+        options.warmStart = true;
+        options.perturbSwaps = stoi(arg.substr(13));
+      } else if (arg.rfind("--temperature=", 0) == 0) {
+        string temperatures = arg.substr(14);
+        size_t colon = temperatures.find(':');
+        options.startTemperature = stod(temperatures.substr(0, colon));
+        if (colon != string::npos) {
+          options.endTemperature = stod(temperatures.substr(colon + 1));
+        }
+      } else {
+        cerr << "Ignoring unknown option: " << arg << endl;
+      }
+    } catch (const logic_error&) {
+      // stoi and friends only name themselves
+      throw invalid_argument("Bad value in " + arg);
+    }
+  }
+
+  // Checked here rather than by the first solve, so a bad size can't end
+  // the program halfway through a session
+  if (options.scoreCacheBits < 0 || options.scoreCacheBits > 30) {
+    throw invalid_argument("--score-cache must be 0 to 30, not " +
+                           to_string(options.scoreCacheBits));
+  }
+
+  // Anywhere else, a stray argument is most likely a typo
+  if (!cli.batchInputs.empty() && cli.batchOutput.empty()) {
+    throw invalid_argument("Files need --batch=DIR: " + cli.batchInputs[0]);
+  }
+  return cli;
+}
+
+void printStatsJson(const CliOptions& cli) {
+  if (cli.statsJson) {
+    cerr << solverStats().toJson() << endl;
+  }
+}
+
 void printMenu() {
   cout << "Ciphers Menu" << endl;
   cout << "------------" << endl;
@@ -145,6 +383,10 @@ void printMenu() {
   cout << "A - Apply Random Substitution Cipher" << endl;
   cout << "S - Decrypt Substitution Cipher from Console" << endl;
   cout << "F - Decrypt Substitution Cipher from File" << endl;
+  cout << "G - Apply Caesar Cipher to File" << endl;
+  cout << "K - Apply Substitution Cipher to File" << endl;
+  cout << "B - Decrypt Many Substitution Cipher Files" << endl;
+  cout << "T - Show Solver Stats for the Last Decryption" << endl;
   cout << "R - Set Random Seed for Testing" << endl;
   cout << "X - Exit Program" << endl;
 }
@@ -175,24 +417,45 @@ char rot(char c, int amount) {
   return c;  // return original char if not found in ALPHABET
 }
 
-string rot(const string& line, int amount) {
-  // TODO: student
-  string result = "";
-
-  for (size_t i = 0; i < line.size(); i++) {
-    if (isalpha(line[i])) {  // if element is a letter...
-      char upperChar = toupper(line[i]);
-      char rotatedChar = rot(upperChar, amount);
-      result += rotatedChar;  // Call the above rot function to do the rotation
-    } else if (isspace(line[i])) {  // If there's a space, keep the space
-      result += ' ';
-    }
-    // For chars that aren't letters or spaces (like punctuation), then they are
-    // skipped and not added to the resulting encrypted string
+// Lookup table for the byte kernels: entry `i` is the `i`th letter rotated
+static void rotTable(int amount, char table[26]) {
+  for (int i = 0; i < 26; i++) {
+    table[i] = rot((char)('A' + i), amount);
   }
+}
+
+string rot(const string& line, int amount) {
+  // Rotate through a lookup table so long lines take the SIMD kernel.
+  // Letters are uppercased and rotated, whitespace becomes a space, and
+  // anything else (like punctuation) is dropped
+  char table[26];
+  rotTable(amount, table);
+
+  string result(line.size(), '\0');
+  result.resize(translateWords(table, line.data(), result.data(), line.size()));
   return result;
 }
 
+// Streams `inputPath` through `translateLetters` into `outputPath`, one
+// chunk at a time
+static bool translateFile(const char table[26], const string& inputPath,
+                          const string& outputPath) {
+  // Written aside and renamed into place, so the output may be the input
+  return replaceFile(outputPath, [&](int out) {
+    return forEachFileChunk(inputPath, FILE_CHUNK_SIZE,
+                            [&](char* chunk, size_t n) {
+                              translateLetters(table, chunk, chunk, n);
+                              return writeAll(out, chunk, n);
+                            });
+  });
+}
+
+bool rotFile(const string& inputPath, const string& outputPath, int amount) {
+  char table[26];
+  rotTable(amount, table);
+  return translateFile(table, inputPath, outputPath);
+}
+
 void caesarEncryptCommand() {  // Helper function for the "c" command
   // TODO: student
   string text;
@@ -208,6 +471,26 @@ void caesarEncryptCommand() {  // Helper function for the "c" command
   cout << "Encrypted Text: " << encryptedText << endl;
 }
 
+void caesarFileCommand() {
+  string inputFile;
+  cout << "Enter input file name: ";
+  getline(cin, inputFile);
+
+  string outputFile;
+  cout << "Enter output file name: ";
+  getline(cin, outputFile);
+
+  string shiftString;
+  cout << "Enter shift amount (negative to decrypt): ";
+  getline(cin, shiftString);
+  int shift = stoi(shiftString);
+
+  if (!rotFile(inputFile, outputFile, shift)) {
+    cout << "Couldn't read " << inputFile << " or write " << outputFile
+         << endl;
+  }
+}
+
 #pragma endregion CaesarEnc
 
 #pragma region CaesarDec
@@ -222,15 +505,17 @@ void rot(vector<string>& strings, int amount) {
 }
 
 string clean(const string& s) {
-  string result;  // Store the cleaned out string
-
-  for (char c : s) {
-    if (isalpha(c)) {
-      result += toupper(c);  // Convert to uppercase if it's a letter
-    }
-    // Else: other characters like punctuation, numbers, spaces are ignored
-  }
+  // Keep only the letters, uppercased; punctuation, numbers, spaces and
+  // everything else are dropped
+  string result(s.size(), '\0');
+  result.resize(compactLetters(s.data(), result.data(), s.size(), 'A'));
+  return result;
+}
 
+vector<uint8_t> cleanToIndices(const string& s) {
+  vector<uint8_t> result(s.size());
+  result.resize(
+      compactLetters(s.data(), (char*)result.data(), s.size(), 0));
   return result;
 }
 
@@ -261,15 +546,93 @@ string joinWithSpaces(const vector<string>& words) {
   return result;
 }
 
+Dictionary::Dictionary(const vector<string>& words) {
+  offsets.reserve(words.size() + 1);
+  for (const string& word : words) {
+    offsets.push_back(arena.size());
+    arena += word;
+  }
+  offsets.push_back(arena.size());
+
+  // Keep the table at most half full so probe runs stay short
+  size_t capacity = 16;
+  while (capacity < 2 * words.size()) {
+    capacity *= 2;
+  }
+  slots.assign(capacity, Slot{0, 0});
+  mask = capacity - 1;
+
+  for (uint32_t i = 0; i < words.size(); i++) {
+    if (contains(wordAt(i))) {
+      continue;  // Duplicates only need one slot
+    }
+    uint64_t h = hash(wordAt(i));
+    size_t slot = h & mask;
+    while (slots[slot].word != 0) {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = Slot{i + 1, (uint32_t)h};
+  }
+}
+
+Dictionary Dictionary::load(const string& path) {
+  vector<string> words;
+  ifstream dict(path);
+  string word;
+  while (getline(dict, word)) {
+    words.push_back(word);
+  }
+  return Dictionary(words);
+}
+
+// 64-bit FNV-1a
+uint64_t Dictionary::hash(string_view word) {
+  uint64_t h = 14695981039346656037ull;
+  for (char c : word) {
+    h ^= (unsigned char)c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+string_view Dictionary::wordAt(uint32_t i) const {
+  return string_view(arena).substr(offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+bool Dictionary::contains(string_view word) const {
+  uint64_t h = hash(word);
+  for (size_t slot = h & mask; slots[slot].word != 0;
+       slot = (slot + 1) & mask) {
+    if (slots[slot].hash == (uint32_t)h &&
+        wordAt(slots[slot].word - 1) == word) {
+      return true;
+    }
+  }
+  return false;
+}
+
 int numWordsIn(const vector<string>& words, const vector<string>& dict) {
+  return numWordsIn(words, Dictionary(dict));
+}
+
+int numWordsIn(const vector<string>& words, const Dictionary& dict) {
   int dictWords = 0;  // Stores how many words were found in the dict
 
-  for (const auto& word : words) {       // Iterates through each word
-    for (const auto& dictWord : dict) {  // Iterates through each dictionary
-                                         // word
-      if (word == dictWord) {  // if the word exists in the dictionary...
-        dictWords++;           // increment the counter
-      }
+  for (const auto& word : words) {  // Iterates through each word
+    if (dict.contains(word)) {      // if the word exists in the dictionary...
+      dictWords++;                  // increment the counter
+    }
+  }
+
+  return dictWords;
+}
+
+int numWordsIn(const vector<string_view>& words, const Dictionary& dict) {
+  int dictWords = 0;
+
+  for (string_view word : words) {
+    if (dict.contains(word)) {
+      dictWords++;
     }
   }
 
@@ -277,6 +640,91 @@ int numWordsIn(const vector<string>& words, const vector<string>& dict) {
 }
 
 void caesarDecryptCommand(const vector<string>& dict) {
+  caesarDecryptCommand(Dictionary(dict));
+}
+
+// English letter frequencies, in percent
+const double ENGLISH_FREQUENCIES[26] = {
+    8.167, 1.492, 2.782, 4.253, 12.702, 2.228, 2.015, 6.094, 6.966,
+    0.153, 0.772, 4.025, 2.406, 6.749,  7.507, 1.929, 0.095, 5.987,
+    6.327, 9.056, 2.758, 0.978, 2.360,  0.150, 1.974, 0.074};
+
+array<int, 26> rankCaesarShifts(const vector<uint8_t>& letters) {
+  size_t counts[26] = {0};
+  for (uint8_t letter : letters) {
+    counts[letter]++;
+  }
+
+  double chiSquared[26];
+  for (int shift = 0; shift < 26; shift++) {
+    chiSquared[shift] = 0;
+    for (int c = 0; c < 26; c++) {
+      // Cipher letter c decrypts to (c + shift) under this rotation
+      double expected =
+          letters.size() * ENGLISH_FREQUENCIES[(c + shift) % 26] / 100;
+      double diff = counts[c] - expected;
+      chiSquared[shift] += diff * diff / expected;
+    }
+  }
+
+  array<int, 26> ranked;
+  for (int shift = 0; shift < 26; shift++) {
+    ranked[shift] = shift;
+  }
+  stable_sort(ranked.begin(), ranked.end(), [&](int a, int b) {
+    return chiSquared[a] < chiSquared[b];
+  });
+  return ranked;
+}
+
+vector<int> findCaesarShifts(const vector<string>& cleanedWords,
+                             const Dictionary& dict) {
+  // Concatenate the words once, remembering where each one ends
+  vector<uint8_t> letters;
+  vector<size_t> wordEnds;
+  for (const string& word : cleanedWords) {
+    for (char c : word) {
+      letters.push_back(c - 'A');
+    }
+    wordEnds.push_back(letters.size());
+  }
+
+  vector<int> candidates;
+  if (letters.size() >= CAESAR_RANKED_MIN_LETTERS) {
+    array<int, 26> ranked = rankCaesarShifts(letters);
+    candidates.assign(ranked.begin(), ranked.begin() + CAESAR_RANKED_CANDIDATES);
+  } else {
+    for (int shift = 0; shift < 26; shift++) {
+      candidates.push_back(shift);
+    }
+  }
+
+  // Rotate each candidate into one reused buffer, and look its words up
+  // through views into it
+  string rotated(letters.size(), ' ');
+  vector<string_view> views(wordEnds.size());
+  vector<int> shifts;
+  for (int shift : candidates) {
+    for (size_t i = 0; i < letters.size(); i++) {
+      rotated[i] = 'A' + (letters[i] + shift) % 26;
+    }
+    size_t start = 0;
+    for (size_t w = 0; w < wordEnds.size(); w++) {
+      views[w] = string_view(rotated).substr(start, wordEnds[w] - start);
+      start = wordEnds[w];
+    }
+
+    // Check if more than half of the words are existing in the dict
+    if (numWordsIn(views, dict) > static_cast<int>(views.size()) / 2) {
+      shifts.push_back(shift);
+    }
+  }
+
+  sort(shifts.begin(), shifts.end());
+  return shifts;
+}
+
+void caesarDecryptCommand(const Dictionary& dict) {
   string text;
   cout << "Enter text to decrypt: ";
   getline(cin, text);  // Get encrypted text from user
@@ -298,23 +746,15 @@ void caesarDecryptCommand(const vector<string>& dict) {
     return;
   }
 
-  bool found = false;
-
-  // Try each shift from 0 to 25
-  for (int i = 0; i < 26; i++) {
+  // Only rotate the whole text for the shifts that pass
+  vector<int> shifts = findCaesarShifts(cleanedWords, dict);
+  for (int shift : shifts) {
     vector<string> rotatedWords = cleanedWords;
-    rot(rotatedWords, i);  // Rotate each word
-
-    int wordCount = numWordsIn(rotatedWords, dict);
-
-    // Check if more than half of the words are existing in the dict
-    if (wordCount > static_cast<int>(rotatedWords.size()) / 2) {
-      cout << joinWithSpaces(rotatedWords) << endl;
-      found = true;
-    }
+    rot(rotatedWords, shift);
+    cout << joinWithSpaces(rotatedWords) << endl;
   }
 
-  if (!found) {
+  if (shifts.empty()) {
     cout << "No good decryptions found" << endl;
   }
 }
@@ -324,26 +764,103 @@ void caesarDecryptCommand(const vector<string>& dict) {
 #pragma region SubstEnc
 
 string applySubstCipher(const vector<char>& cipher, const string& s) {
-  string result;  // Will store the transformed chars
+  return applySubstKey(toSubstKey(cipher), s);
+}
 
-  for (char i : s) {              // loop through string
-    bool origLower = islower(i);  // Track if the char was originally lower case
+SubstKey toSubstKey(const vector<char>& cipher) {
+  SubstKey key;
+  for (size_t i = 0; i < key.size(); i++) {
+    key[i] = cipher.at(i) - 'A';
+  }
+  return key;
+}
 
-    if (isalpha(i)) {  // if its a letter..
-      char upperChar = toupper(i);
-      char matching =
-          cipher[upperChar - 'A'];  // Find the char in 'cipher' at that index
+vector<char> fromSubstKey(const SubstKey& key) {
+  vector<char> cipher;
+  for (uint8_t letter : key) {
+    cipher.push_back('A' + letter);
+  }
+  return cipher;
+}
 
-      result += matching;
+void applySubstKey(const SubstKey& key, const uint8_t* in, uint8_t* out,
+                   size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = key[in[i]];
+  }
+}
 
-    } else {
-      result += i;  // Non-letters are left the same
-    }
+// Lookup table for the byte kernels: entry `i` is the uppercase letter the
+// `i`th letter maps to
+static void keyTable(const SubstKey& key, char table[26]) {
+  for (int i = 0; i < 26; i++) {
+    table[i] = 'A' + key[i];
   }
+}
 
+string applySubstKey(const SubstKey& key, const string& s) {
+  // Letters go through the key (uppercased), everything else is left alone
+  char table[26];
+  keyTable(key, table);
+
+  string result(s.size(), '\0');
+  translateLetters(table, s.data(), result.data(), s.size());
   return result;
 }
 
+SubstKey invertSubstKey(const SubstKey& key) {
+  SubstKey inverse;
+  for (int i = 0; i < 26; i++) {
+    inverse[key[i]] = i;
+  }
+  return inverse;
+}
+
+bool applySubstKeyToFile(const SubstKey& key, const string& inputPath,
+                         const string& outputPath) {
+  char table[26];
+  keyTable(key, table);
+  return translateFile(table, inputPath, outputPath);
+}
+
+void applySubstFileCommand() {
+  string inputFile;
+  cout << "Enter input file name: ";
+  getline(cin, inputFile);
+
+  string outputFile;
+  cout << "Enter output file name: ";
+  getline(cin, outputFile);
+
+  string cipherString;
+  cout << "Enter the cipher (the 26 letters A to Z map to): ";
+  getline(cin, cipherString);
+  cipherString = clean(cipherString);
+
+  // A cipher must use every letter exactly once
+  string sorted = cipherString;
+  sort(sorted.begin(), sorted.end());
+  if (sorted != ALPHABET) {
+    cout << "Invalid cipher: " << cipherString << endl;
+    return;
+  }
+
+  string mode;
+  cout << "Encrypt or decrypt (E/D): ";
+  getline(cin, mode);
+
+  SubstKey key =
+      toSubstKey(vector<char>(cipherString.begin(), cipherString.end()));
+  if (mode == "D" || mode == "d") {
+    key = invertSubstKey(key);
+  }
+
+  if (!applySubstKeyToFile(key, inputFile, outputFile)) {
+    cout << "Couldn't read " << inputFile << " or write " << outputFile
+         << endl;
+  }
+}
+
 void applyRandSubstCipherCommand() {
   cout << "Enter text to encrypt: ";
   string input;
@@ -360,18 +877,23 @@ void applyRandSubstCipherCommand() {
 #pragma region SubstDec
 
 double scoreString(const QuadgramScorer& scorer, const string& s) {
-  double totalScore = 0.0;
-
-  // Loop for breaking up string into quadgrams:
-  for (size_t i = 0; i <= s.size() - 4;
-       i++) {  // stop when there are fewer than 4 characters left to form a
-               // complete quadgram
-    string quad = s.substr(i, 4);
-
-    totalScore += scorer.getScore(quad);
+  // Validate once here, so the scorer itself doesn't have to
+  vector<uint8_t> text;
+  text.reserve(s.size());
+  for (char c : s) {
+    if (!isupper(c)) {
+      throw invalid_argument("String passed to scoreString, <" + s +
+                             ">, has character(s) that are not uppercase "
+                             "letters");
+    }
+    text.push_back(c - 'A');
   }
 
-  return totalScore;
+  return scoreIndices(scorer, text);
+}
+
+double scoreIndices(const QuadgramScorer& scorer, const vector<uint8_t>& text) {
+  return scorer.scoreIndices(text.data(), text.size());
 }
 
 void computeEnglishnessCommand(const QuadgramScorer& scorer) {
@@ -391,76 +913,2701 @@ void computeEnglishnessCommand(const QuadgramScorer& scorer) {
   cout << "The computed Englishness is: " << score << endl;
 }
 
-// Helper function for decryptSubstCipher:
-vector<char> findBestScore(const QuadgramScorer& scorer,
-                           const string& ciphertext) {
-  vector<char> key = genRandomSubstCipher();  // generate random key initally
-  string decText =
-      applySubstCipher(key, ciphertext);  // decrypt text with current key
-  double bestScore = scoreString(scorer, decText);  // current best score
+QuadgramTerms::QuadgramTerms(const vector<uint8_t>& ciphertext,
+                             ScoringMode mode) {
+  size_t nQuadgrams = ciphertext.size() < 4 ? 0 : ciphertext.size() - 3;
 
-  int failedSwaps = 0;  // Count consecutive failed swaps
+  const uint32_t nIndices = 26 * 26 * 26 * 26;
 
-  while (failedSwaps < 1000) {  // max 1000 swaps
-    // Get random indices (which represent letters)
-    int letter1 = Random::randInt(25);
-    int letter2;
-    do {  // Get a completely different random index for letter2:
-      letter2 = Random::randInt(25);
-    } while (letter2 == letter1);
+  // Index of each quadgram position, rolled forward like scoreIndices does
+  vector<uint32_t> indices(nQuadgrams);
+  uint32_t idx = 0;
+  for (size_t i = 0; i < ciphertext.size(); i++) {
+    idx = (idx * 26 + ciphertext[i]) % nIndices;
+    if (i >= 3) {
+      indices[i - 3] = idx;
+    }
+  }
 
-    // Swap letters
-    swap(key[letter1], key[letter2]);
-    string newDec = applySubstCipher(key, ciphertext);  // decrypt w/ new key
-    double newScore = scoreString(scorer, newDec);
+  // Count every index in one pass, bucketed by index. The buckets are kept
+  // per thread and only the ones this text touched are cleared, so short
+  // texts don't pay for all 26^4 of them.
+  static thread_local vector<uint32_t> occurrences(nIndices);
+  vector<uint32_t> distinct;
+  for (uint32_t index : indices) {
+    if (occurrences[index]++ == 0) {
+      distinct.push_back(index);
+    }
+  }
 
-    // Keep the change only if the score improves
-    if (newScore > bestScore) {
-      bestScore = newScore;
-      failedSwaps = 0;  // Reset failure count if we improve
-    } else {
-      swap(key[letter1], key[letter2]);  // Undo swap if it didn't help
-      failedSwaps++;                     // Count failed swaps
+  // In increasing order: walking the buckets is linear, and cheaper than
+  // sorting once a text has this many different quadgrams
+  if (distinct.size() * 16 >= nIndices) {
+    distinct.clear();
+    for (uint32_t index = 0; index < nIndices; index++) {
+      if (occurrences[index] > 0) {
+        distinct.push_back(index);
+      }
     }
+  } else {
+    sort(distinct.begin(), distinct.end());
   }
 
-  return key;
+  histogram = mode == ScoringMode::Histogram ||
+              (mode == ScoringMode::Auto && distinct.size() * 2 <= nQuadgrams);
+  if (histogram) {
+    counts.resize(distinct.size());
+    for (size_t term = 0; term < distinct.size(); term++) {
+      counts[term] = occurrences[distinct[term]];
+    }
+    indices = distinct;
+  } else {
+    counts.assign(nQuadgrams, 1);
+  }
+  for (uint32_t index : distinct) {
+    occurrences[index] = 0;
+  }
+
+  letters.resize(indices.size());
+  for (uint32_t term = 0; term < indices.size(); term++) {
+    uint32_t index = indices[term];
+    for (int j = 3; j >= 0; j--) {
+      letters[term][j] = index % 26;
+      index /= 26;
+    }
+
+    // Terms are visited in increasing order, so only the tail can repeat
+    for (uint8_t letter : letters[term]) {
+      if (byLetter[letter].empty() || byLetter[letter].back() != term) {
+        byLetter[letter].push_back(term);
+      }
+    }
+  }
 }
 
-vector<char> decryptSubstCipher(const QuadgramScorer& scorer,
-                                const string& ciphertext) {
-  vector<char> bestSub;
-  double bestOverall = -1e9;  // best score will start low
+double QuadgramTerms::score(const QuadgramScorer& scorer,
+                            const SubstKey& key) const {
+  double total = 0.0;
+  for (uint32_t term = 0; term < letters.size(); term++) {
+    total += termScore(scorer, key, term);
+  }
+  return total;
+}
+
+template <>
+QuadgramTable<double>::QuadgramTable(const QuadgramScorer& scorer)
+    : values(scorer.table()) {}
+
+template <>
+QuadgramTable<float>::QuadgramTable(const QuadgramScorer& scorer)
+    : values(scorer.getFloatTable().data()) {
+  if (scorer.getFormat() != TableFormat::Float) {
+    throw invalid_argument("The scorer has no float table");
+  }
+}
+
+template <>
+QuadgramTable<int16_t>::QuadgramTable(const QuadgramScorer& scorer)
+    : values(scorer.getInt16Table().data()),
+      scale(scorer.getFixedScale()),
+      offset(scorer.getFixedOffset()) {
+  if (scorer.getFormat() != TableFormat::Int16) {
+    throw invalid_argument("The scorer has no int16 table");
+  }
+}
+
+template <>
+QuadgramTable<uint8_t>::QuadgramTable(const QuadgramScorer& scorer)
+    : values(scorer.getUint8Table().data()),
+      scale(scorer.getFixedScale()),
+      offset(scorer.getFixedOffset()) {
+  if (scorer.getFormat() != TableFormat::Uint8) {
+    throw invalid_argument("The scorer has no uint8 table");
+  }
+}
+
+// Calls `f` with the table of the scorer's format, so everything `f` does
+// reads that type directly
+template <class F>
+static auto withQuadgramTable(const QuadgramScorer& scorer, F f) {
+  switch (scorer.getFormat()) {
+    case TableFormat::Float:
+      return f(QuadgramTable<float>(scorer));
+    case TableFormat::Int16:
+      return f(QuadgramTable<int16_t>(scorer));
+    case TableFormat::Uint8:
+      return f(QuadgramTable<uint8_t>(scorer));
+    default:
+      return f(QuadgramTable<double>(scorer));
+  }
+}
+
+template <class Table>
+IncrementalScorer<Table>::IncrementalScorer(const QuadgramScorer& scorer,
+                                            const QuadgramTerms& terms,
+                                            const SubstKey& key)
+    : table(scorer),
+      terms(terms),
+      key(key),
+      currentScore(0),
+      pendingScore(0),
+      pending1(-1),
+      pending2(-1),
+      scored(terms.size()) {
+  for (uint32_t term = 0; term < terms.size(); term++) {
+    currentScore += terms.termValue(table, key, term);
+  }
+  affected.reserve(terms.size());
+}
+
+template <class Table>
+auto IncrementalScorer<Table>::scoreAffected() const -> Sum {
+  Sum total = 0;
+  for (uint32_t term : affected) {
+    total += terms.termValue(table, key, term);
+  }
+  return total;
+}
 
-  string cleanedText = clean(ciphertext);
+template <class Table>
+auto IncrementalScorer<Table>::trySwap(int letter1, int letter2) -> Sum {
+  pending1 = letter1;
+  pending2 = letter2;
+
+  // Only terms containing one of the two cipher letters can change
+  const vector<uint32_t>& terms1 = terms.termsWith(letter1);
+  const vector<uint32_t>& terms2 = terms.termsWith(letter2);
+  affected.clear();
+  set_union(terms1.begin(), terms1.end(), terms2.begin(), terms2.end(),
+            back_inserter(affected));
+
+  Sum before = scoreAffected();
+  swap(key[letter1], key[letter2]);
+  Sum after = scoreAffected();
+  CIPHERS_STAT(scored += 2 * affected.size());
+
+  pendingScore = currentScore + (after - before);
+  return pendingScore;
+}
+
+template <class Table>
+void IncrementalScorer<Table>::commit() {
+  currentScore = pendingScore;
+  pending1 = pending2 = -1;
+}
 
-  for (size_t i = 0; i < 25; i++) {  //"run hill" algorithm 25 times
-    vector<char> maybeKey = findBestScore(scorer, cleanedText);  // Run the 1000 swaps to find the best possible sub key
-    string decrypted = applySubstCipher(maybeKey, cleanedText);  // Apply key to convert encrypted text back to English
-    double maybeScore = scoreString(scorer, decrypted);  // Compute Englishness score of new decrypted text
+template <class Table>
+void IncrementalScorer<Table>::rollback() {
+  swap(key[pending1], key[pending2]);
+  pending1 = pending2 = -1;
+}
 
-    if (maybeScore > bestOverall) {  // If potential score is better than the
-                                     // current best score
-      bestOverall = maybeScore;      // then it will be the new best score
-      bestSub = maybeKey;            // Keep the best key found
+template class IncrementalScorer<QuadgramTable<double>>;
+template class IncrementalScorer<QuadgramTable<float>>;
+template class IncrementalScorer<QuadgramTable<int16_t>>;
+template class IncrementalScorer<QuadgramTable<uint8_t>>;
+
+// One random number per (cipher letter, plain letter), from a fixed seed so
+// hashes are the same in every run
+static const array<array<uint64_t, 26>, 26>& zobristTable() {
+  static const array<array<uint64_t, 26>, 26> table = [] {
+    array<array<uint64_t, 26>, 26> numbers;
+    Xoshiro256 rng(0x5C0DE);
+    for (array<uint64_t, 26>& row : numbers) {
+      for (uint64_t& number : row) {
+        number = (uint64_t)rng() << 32 | rng();
+      }
     }
+    return numbers;
+  }();
+  return table;
+}
+
+ScoreCache::ScoreCache(int bits) {
+  if (bits < 1 || bits > 30) {
+    throw invalid_argument("Score cache bits must be 1 to 30, not " +
+                           to_string(bits));
   }
+  slots.reset(new Slot[(size_t)1 << bits]);
+  mask = ((size_t)1 << bits) - 1;
+}
 
-  return bestSub;
+uint64_t ScoreCache::hash(const SubstKey& key) {
+  const array<array<uint64_t, 26>, 26>& zobrist = zobristTable();
+  uint64_t hash = 0;
+  for (int letter = 0; letter < 26; letter++) {
+    hash ^= zobrist[letter][key[letter]];
+  }
+  return hash;
 }
 
-void decryptSubstCipherCommand(const QuadgramScorer& scorer) {
-  cout << "Enter text to decrypt: ";
-  string input;
-  getline(cin, input);
+uint64_t ScoreCache::swapHash(const SubstKey& key, int letter1, int letter2) {
+  const array<array<uint64_t, 26>, 26>& zobrist = zobristTable();
+  return zobrist[letter1][key[letter1]] ^ zobrist[letter1][key[letter2]] ^
+         zobrist[letter2][key[letter2]] ^ zobrist[letter2][key[letter1]];
+}
 
-  // Decrypt the text using the best key
-  vector<char> bestKey = decryptSubstCipher(scorer, input);
+bool ScoreCache::find(uint64_t hash, double& score) const noexcept {
+  const Slot& slot = slots[hash & mask];
+  uint64_t bits = slot.bits.load(memory_order_relaxed);
+  if ((slot.check.load(memory_order_relaxed) ^ bits) != hash) {
+    return false;
+  }
+  memcpy(&score, &bits, sizeof(score));
+  return true;
+}
 
-  // Apply the best key to actually decrypt the text
-  string decryptedText = applySubstCipher(bestKey, input);
+void ScoreCache::store(uint64_t hash, double score) noexcept {
+  uint64_t bits;
+  memcpy(&bits, &score, sizeof(bits));
+  Slot& slot = slots[hash & mask];
+  slot.check.store(hash ^ bits, memory_order_relaxed);
+  slot.bits.store(bits, memory_order_relaxed);
+}
 
-  cout << "Decrypted text: " << decryptedText << endl;
+// Whether `cache` has a score for the key `hash` that is clearly below
+// `threshold`, so a swap to that key can be turned down without scoring it
+static bool cachedBelow(const ScoreCache* cache, uint64_t hash,
+                        double threshold,
+                        [[maybe_unused]] RestartCounters& counters) {
+  CIPHERS_STAT(counters.cacheLookups++);
+  double cached;
+  if (cache->find(hash, cached) &&
+      cached < threshold - SCORE_CACHE_MARGIN * (1 + fabs(threshold))) {
+    CIPHERS_STAT(counters.cacheHits++);
+    return true;
+  }
+  return false;
 }
 
-#pragma endregion SubstDec
+// When a restart has to stop before it would finish on its own. The swap cap
+// is deterministic; the deadline and `cancel` depend on timing, so they're
+// only checked every `CHECK_EVERY` swaps to keep the clock off the hot path.
+struct RestartLimits {
+  static const uint64_t CHECK_EVERY = 256;
+
+  uint64_t swaps = numeric_limits<uint64_t>::max();
+  chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::time_point::max();
+  const atomic<bool>* cancel = nullptr;
+
+  bool reached(uint64_t swapsDone) const {
+    if (swapsDone >= swaps) {
+      return true;
+    }
+    if (swapsDone % CHECK_EVERY != 0) {
+      return false;
+    }
+    return (cancel != nullptr && cancel->load(memory_order_relaxed)) ||
+           (deadline != chrono::steady_clock::time_point::max() &&
+            chrono::steady_clock::now() >= deadline);
+  }
+};
+
+// Helper function for solveSubstKey, reading quadgrams from `Table`:
+template <class Table, class Engine>
+SubstKey findBestScore(const QuadgramScorer& scorer,
+                       const QuadgramTerms& terms, const SubstKey& start,
+                       Engine& rng, RestartCounters& counters,
+                       const RestartLimits& limits = RestartLimits(),
+                       ScoreCache* cache = nullptr) {
+  // Only rescore what each swap changes
+  IncrementalScorer<Table> state(scorer, terms, start);
+  uint64_t hash = cache != nullptr ? ScoreCache::hash(start) : 0;
+
+  int failedSwaps = 0;  // Count consecutive failed swaps
+  uint64_t swaps = 0;
+
+  // Hill climbing never gets worse, so stopping early still returns the best
+  // key this restart has seen
+  while (failedSwaps < 1000 && !limits.reached(swaps++)) {  // max 1000 swaps
+    // Get random indices (which represent letters)
+    int letter1 = Random::randInt(rng, 25);
+    int letter2;
+    do {  // Get a completely different random index for letter2:
+      letter2 = Random::randInt(rng, 25);
+    } while (letter2 == letter1);
+
+    // A swap of two letters the text doesn't use scores nothing anyway
+    bool cached = cache != nullptr && (!terms.termsWith(letter1).empty() ||
+                                       !terms.termsWith(letter2).empty());
+    uint64_t newHash = 0;
+    if (cached) {
+      newHash = hash ^ ScoreCache::swapHash(state.getKey(), letter1, letter2);
+      if (cachedBelow(cache, newHash, state.getScore(), counters)) {
+        counters.swapsProposed++;
+        failedSwaps++;
+        continue;
+      }
+    }
+
+    // Swap letters
+    typename Table::Sum newScore = state.trySwap(letter1, letter2);
+    counters.swapsProposed++;
+    if (cached) {
+      cache->store(newHash, newScore);
+    }
+
+    // Keep the change only if the score improves
+    if (newScore > state.getScore()) {
+      state.commit();
+      CIPHERS_STAT(counters.swapsAccepted++);
+      failedSwaps = 0;  // Reset failure count if we improve
+      hash = cached ? newHash : hash;
+    } else {
+      state.rollback();  // Undo swap if it didn't help
+      failedSwaps++;     // Count failed swaps
+    }
+  }
+
+  CIPHERS_STAT(counters.quadgramsScored += state.quadgramsScored());
+  return state.getKey();
+}
+
+// Helper function for solveSubstKey: simulated annealing from `start`
+template <class Table, class Engine>
+SubstKey annealBestScore(const QuadgramScorer& scorer,
+                         const QuadgramTerms& terms, size_t nQuadgrams,
+                         const SubstKey& start, const SolverOptions& options,
+                         Engine& rng, RestartCounters& counters,
+                         const RestartLimits& limits = RestartLimits()) {
+  IncrementalScorer<Table> state(scorer, terms, start);
+  SubstKey bestKey = state.getKey();
+  typename Table::Sum bestScore = state.getScore();
+
+  // Score changes grow with the text, so scale the temperatures to match
+  nQuadgrams = max<size_t>(nQuadgrams, 1);
+  double temperature = options.startTemperature * nQuadgrams;
+  double cooling = pow(options.endTemperature / options.startTemperature,
+                       1.0 / max(1L, options.annealIterations));
+
+  for (long i = 0; i < options.annealIterations && !limits.reached(i); i++) {
+    int letter1 = Random::randInt(rng, 25);
+    int letter2;
+    do {
+      letter2 = Random::randInt(rng, 25);
+    } while (letter2 == letter1);
+
+    // The temperatures are in log likelihoods, whatever the table's units
+    double change = state.getTable().scale *
+                    (state.trySwap(letter1, letter2) - state.getScore());
+    counters.swapsProposed++;
+
+    // Always keep improvements; keep a worse key with probability
+    // e^(change / temperature). The uniform draw is built from the raw
+    // engine output, since STL distributions aren't portable.
+    double uniform = rng() / 4294967296.0;
+    if (change > 0 || uniform < exp(change / temperature)) {
+      state.commit();
+      CIPHERS_STAT(counters.swapsAccepted++);
+      if (state.getScore() > bestScore) {
+        bestScore = state.getScore();
+        bestKey = state.getKey();
+      }
+    } else {
+      state.rollback();
+    }
+
+    temperature *= cooling;
+  }
+
+  CIPHERS_STAT(counters.quadgramsScored += state.quadgramsScored());
+  return bestKey;
+}
+
+// Helper function for solveSubstKey: climbs from `start` by trying every
+// swap that changes the text, and taking the best improving one, or with
+// `firstImprovement` the first. Stops once a whole sweep finds nothing
+// better, so the key is a local optimum over all swaps.
+template <class Table>
+static SubstKey sweepBestScore(const QuadgramScorer& scorer,
+                               const QuadgramTerms& terms,
+                               const SubstKey& start, bool firstImprovement,
+                               RestartCounters& counters,
+                               const RestartLimits& limits = RestartLimits()) {
+  SubstKey key = start;
+
+  // Swapping two letters the text doesn't use changes nothing
+  vector<pair<int, int>> swaps;
+  for (int letter1 = 0; letter1 < 26; letter1++) {
+    for (int letter2 = letter1 + 1; letter2 < 26; letter2++) {
+      if (!terms.termsWith(letter1).empty() ||
+          !terms.termsWith(letter2).empty()) {
+        swaps.emplace_back(letter1, letter2);
+      }
+    }
+  }
+
+  // Every term's score under `key`, so a candidate only looks up the
+  // quadgrams it changes, and the swaps in a sweep share them
+  Table table(scorer);
+  vector<typename Table::Sum> termScores(terms.size());
+  for (uint32_t term = 0; term < terms.size(); term++) {
+    termScores[term] = terms.termValue(table, key, term);
+  }
+  CIPHERS_STAT(counters.quadgramsScored += terms.size());
+
+  vector<uint32_t> affected;
+  auto findAffected = [&](const pair<int, int>& letters) {
+    const vector<uint32_t>& terms1 = terms.termsWith(letters.first);
+    const vector<uint32_t>& terms2 = terms.termsWith(letters.second);
+    affected.clear();
+    set_union(terms1.begin(), terms1.end(), terms2.begin(), terms2.end(),
+              back_inserter(affected));
+  };
+
+  uint64_t proposed = 0;
+  size_t next = 0;  // Where a first-improvement sweep picks up
+  while (true) {
+    size_t best = swaps.size();
+    typename Table::Sum bestChange = 0;
+    for (size_t tried = 0; tried < swaps.size(); tried++) {
+      if (limits.reached(proposed++)) {
+        return key;
+      }
+      size_t candidate = (next + tried) % swaps.size();
+      const pair<int, int>& letters = swaps[candidate];
+      findAffected(letters);
+
+      typename Table::Sum change = 0;
+      swap(key[letters.first], key[letters.second]);
+      for (uint32_t term : affected) {
+        change += terms.termValue(table, key, term) - termScores[term];
+      }
+      swap(key[letters.first], key[letters.second]);
+      counters.swapsProposed++;
+      CIPHERS_STAT(counters.quadgramsScored += affected.size());
+
+      if (change > bestChange) {
+        best = candidate;
+        bestChange = change;
+        if (firstImprovement) {
+          break;
+        }
+      }
+    }
+
+    // No swap improves the key
+    if (best == swaps.size()) {
+      return key;
+    }
+
+    const pair<int, int>& letters = swaps[best];
+    swap(key[letters.first], key[letters.second]);
+    findAffected(letters);
+    for (uint32_t term : affected) {
+      termScores[term] = terms.termValue(table, key, term);
+    }
+    CIPHERS_STAT(counters.quadgramsScored += affected.size());
+    CIPHERS_STAT(counters.swapsAccepted++);
+    next = best + 1;
+  }
+}
+
+// English letters from most to least common
+const string ENGLISH_BY_FREQUENCY = "ETAOINSHRDLCUMWFGYPBVKJXQZ";
+
+SubstKey frequencyKey(const vector<uint8_t>& ciphertext) {
+  size_t counts[26] = {0};
+  for (uint8_t letter : ciphertext) {
+    counts[letter]++;
+  }
+
+  // Rank cipher letters by count; ties keep alphabetical order so the key
+  // only depends on the text
+  array<uint8_t, 26> ranked;
+  for (int i = 0; i < 26; i++) {
+    ranked[i] = i;
+  }
+  stable_sort(ranked.begin(), ranked.end(),
+              [&](uint8_t a, uint8_t b) { return counts[a] > counts[b]; });
+
+  SubstKey key;
+  for (int rank = 0; rank < 26; rank++) {
+    key[ranked[rank]] = ENGLISH_BY_FREQUENCY[rank] - 'A';
+  }
+  return key;
+}
+
+// Starting key for restart `restart`: random, or with a warm start, the
+// frequency key for the first restart and a few random swaps of it after
+template <class Engine>
+static SubstKey startingKey(const SubstKey& warmKey, size_t restart,
+                            const SolverOptions& options, Engine& rng) {
+  if (!options.warmStart) {
+    return toSubstKey(genRandomSubstCipher(rng));
+  }
+
+  SubstKey key = warmKey;
+  for (int i = 0; restart > 0 && i < options.perturbSwaps; i++) {
+    swap(key[Random::randInt(rng, 25)], key[Random::randInt(rng, 25)]);
+  }
+  return key;
+}
+
+vector<uint8_t> sampleCiphertext(const vector<uint8_t>& ciphertext,
+                                 size_t length) {
+  if (ciphertext.size() <= length) {
+    return ciphertext;
+  }
+
+  // The stretches are joined end to end, which adds 3 made-up quadgrams per
+  // join; next to thousands of real ones they don't matter
+  size_t spanLength = max<size_t>(length / SAMPLE_SPANS, 1);
+  size_t gap = (ciphertext.size() - spanLength) / (SAMPLE_SPANS - 1);
+  vector<uint8_t> sample;
+  sample.reserve(spanLength * SAMPLE_SPANS);
+  for (int i = 0; i < SAMPLE_SPANS; i++) {
+    auto start = ciphertext.begin() + i * gap;
+    sample.insert(sample.end(), start, start + spanLength);
+  }
+  return sample;
+}
+
+// The generator for restart `restart` of job `job` in a solve that drew
+// `seed`
+template <class Engine>
+static Engine restartRng(uint32_t seed, uint32_t job, uint32_t restart);
+
+template <>
+mt19937 restartRng<mt19937>(uint32_t seed, uint32_t job, uint32_t restart) {
+  // Job 0 keeps the seeding from before jobs existed
+  seed_seq seq = {seed, restart};
+  seed_seq jobSeq = {seed, restart, job};
+  return mt19937(job == 0 ? seq : jobSeq);
+}
+
+template <>
+Xoshiro256 restartRng<Xoshiro256>(uint32_t seed, uint32_t job,
+                                  uint32_t restart) {
+  return Xoshiro256(((uint64_t)seed << 32 | restart) ^
+                    (uint64_t)job * 0x9E3779B97F4A7C15ull);
+}
+
+template <>
+Philox restartRng<Philox>(uint32_t seed, uint32_t job, uint32_t restart) {
+  return Philox(seed, job, restart);
+}
+
+// Calls `f` with a null pointer to the generator type `options.rng` selects,
+// for code that makes many generators of it
+template <class F>
+static auto withRngType(const SolverOptions& options, F f) {
+  if (options.rng == RngEngine::Mt19937) {
+    return f((mt19937*)nullptr);
+  } else if (options.rng == RngEngine::Xoshiro) {
+    return f((Xoshiro256*)nullptr);
+  }
+  return f((Philox*)nullptr);
+}
+
+// Calls `f` with the generator for restart `restart` of job `options.job` in
+// a solve that drew `seed`
+template <class F>
+static auto withRestartRng(uint32_t seed, uint32_t restart,
+                           const SolverOptions& options, F f) {
+  return withRngType(options, [&](auto* type) {
+    auto rng = restartRng<remove_pointer_t<decltype(type)>>(seed, options.job,
+                                                            restart);
+    return f(rng);
+  });
+}
+
+// Restart body shared by `solveSubstKey` and `solveSubstRestart`
+static RestartResult runRestart(const QuadgramScorer& scorer,
+                                const QuadgramTerms& terms,
+                                const SubstKey& warmKey, size_t nQuadgrams,
+                                uint32_t seed, uint32_t restart,
+                                const SolverOptions& options,
+                                const RestartLimits& limits,
+                                ScoreCache* cache) {
+  return withRestartRng(seed, restart, options, [&](auto& rng) {
+    RestartResult result;
+    SubstKey start = startingKey(warmKey, restart, options, rng);
+    withQuadgramTable(scorer, [&](auto table) {
+      using Table = decltype(table);
+      if (options.engine == SolverEngine::Anneal) {
+        result.key = annealBestScore<Table>(scorer, terms, nQuadgrams, start,
+                                            options, rng, result.counters,
+                                            limits);
+      } else if (options.engine == SolverEngine::BestSwap ||
+                 options.engine == SolverEngine::FirstSwap) {
+        result.key = sweepBestScore<Table>(
+            scorer, terms, start, options.engine == SolverEngine::FirstSwap,
+            result.counters, limits);
+      } else {
+        // Run the 1000 swaps to find the best possible sub key
+        result.key = findBestScore<Table>(scorer, terms, start, rng,
+                                          result.counters, limits, cache);
+      }
+    });
+    // Compute Englishness score of the decrypted text from scratch
+    result.score = terms.score(scorer, result.key);
+    CIPHERS_STAT(result.counters.quadgramsScored += terms.size());
+    return result;
+  });
+}
+
+static size_t quadgramCount(const vector<uint8_t>& ciphertext) {
+  return ciphertext.size() < 4 ? 0 : ciphertext.size() - 3;
+}
+
+int restartCount(const SolverOptions& options) {
+  if (options.restarts > 0) {
+    return options.restarts;
+  }
+  return options.engine == SolverEngine::Anneal ? 4 : 25;
+}
+
+// No single restart may spend more than the whole swap budget
+static RestartLimits swapLimits(const SolverOptions& options) {
+  RestartLimits limits;
+  if (options.swapLimit > 0) {
+    limits.swaps = options.swapLimit;
+  }
+  return limits;
+}
+
+RestartResult solveSubstRestart(const QuadgramScorer& scorer,
+                                const vector<uint8_t>& ciphertext,
+                                const QuadgramTerms& terms, uint32_t seed,
+                                uint32_t restart,
+                                const SolverOptions& options) {
+  return runRestart(scorer, terms, frequencyKey(ciphertext),
+                    quadgramCount(ciphertext), seed, restart, options,
+                    swapLimits(options), nullptr);
+}
+
+SubstKey bestRestart(const vector<RestartResult>& results) {
+  SubstKey bestSub = {};
+  // Long texts score far below any fixed floor, so start below them all
+  double bestOverall = -numeric_limits<double>::infinity();
+  for (const RestartResult& result : results) {
+    if (result.score > bestOverall) {  // If potential score is better than
+                                       // the current best score
+      bestOverall = result.score;      // then it will be the new best score
+      bestSub = result.key;            // Keep the best key found
+    }
+  }
+  return bestSub;
+}
+
+// The swap cap and deadline of a solve with `options` that starts now
+static RestartLimits budgetLimits(const SolverOptions& options) {
+  RestartLimits limits = swapLimits(options);
+  if (options.timeLimit > 0) {
+    limits.deadline = chrono::steady_clock::now() +
+                      chrono::duration_cast<chrono::steady_clock::duration>(
+                          chrono::duration<double>(options.timeLimit));
+  }
+  return limits;
+}
+
+// The restarts of `solveSubstKey` on the whole of `ciphertext`. Sets
+// `swapsCounted` to the swaps of the restarts counted towards the swap
+// budget, which don't depend on the thread count.
+static SubstKey solveRestarts(const QuadgramScorer& scorer,
+                              const vector<uint8_t>& ciphertext,
+                              const SolverOptions& options,
+                              RestartLimits limits, uint64_t& swapsCounted) {
+  PhaseTimer timer(solverStats().climbSeconds);
+  int restarts = restartCount(options);
+
+  // One draw from the shared generator per call, so the `R` seed still
+  // decides everything, and every restart gets its own stream from it
+  uint32_t callSeed = Random::drawSeed();
+
+  vector<RestartResult> results(restarts);
+  SubstKey warmKey = frequencyKey(ciphertext);
+
+  // Built once and shared read-only by every restart
+  QuadgramTerms terms(ciphertext, options.scoring);
+  size_t nQuadgrams = quadgramCount(ciphertext);
+
+  // Only hill climbing uses the cache: annealing keeps worse keys too, so it
+  // needs every score exactly, and the sweeps seldom see a key twice
+  unique_ptr<ScoreCache> cache;
+  if (options.scoreCacheBits > 0 &&
+      options.engine == SolverEngine::HillClimb) {
+    cache = make_unique<ScoreCache>(options.scoreCacheBits);
+  }
+
+  // Early stopping and the swap budget only look at the unbroken run of
+  // finished restarts from restart 0, so where they stop doesn't depend on
+  // which threads finished first. `used` is how many restarts count towards
+  // the answer.
+  atomic<bool> cancel(false);
+  limits.cancel = &cancel;
+  mutex progress;
+  vector<bool> done(restarts);
+  size_t used = restarts;
+  size_t finished = 0;
+  double bestScore = -numeric_limits<double>::infinity();
+  int agreeing = 0;
+  uint64_t swaps = 0;
+
+  parallelFor(restarts, options.threads, [&](size_t i) {
+    // Restart 0 always runs, so there's always a key to return
+    if (i > 0 && limits.reached(0)) {
+      return;
+    }
+    RestartResult result = runRestart(scorer, terms, warmKey, nQuadgrams,
+                                      callSeed, i, options, limits,
+                                      cache.get());
+
+    lock_guard<mutex> lock(progress);
+    results[i] = result;
+    done[i] = true;
+    for (; finished < used && done[finished]; finished++) {
+      const RestartResult& next = results[finished];
+      // Scores are computed from scratch, so restarts that found the same
+      // key have exactly the same score
+      if (next.score > bestScore) {
+        bestScore = next.score;
+        agreeing = 1;
+      } else if (next.score == bestScore) {
+        agreeing++;
+      }
+      swaps += next.counters.swapsProposed;
+      if ((options.agreeRestarts > 0 && agreeing >= options.agreeRestarts) ||
+          (options.swapLimit > 0 && swaps >= options.swapLimit)) {
+        used = finished + 1;
+        cancel = true;
+      }
+    }
+  });
+
+  // Past a deadline, keep whatever finished; restarts that never ran have no
+  // key to offer
+  if (used == (size_t)restarts) {
+    used = 0;
+    for (size_t i = 0; i < done.size(); i++) {
+      used = done[i] ? i + 1 : used;
+    }
+  }
+  results.resize(used);
+  for (size_t i = 0; i < used; i++) {
+    if (!done[i]) {
+      results[i].score = -numeric_limits<double>::infinity();
+    }
+  }
+
+  // Count and reduce in restart order, so ties always go to the same restart
+  CIPHERS_STAT(for (size_t i = 0; i < used; i++) {
+    if (done[i]) {
+      solverStats().addRestart(results[i].counters, results[i].score);
+    }
+  });
+  swapsCounted = swaps;
+  return bestRestart(results);
+}
+
+SubstKey solveSubstKey(const QuadgramScorer& scorer,
+                       const vector<uint8_t>& ciphertext,
+                       const SolverOptions& options) {
+  RestartLimits limits = budgetLimits(options);
+  uint64_t swaps = 0;
+
+  if (options.sampleLetters > 0 && ciphertext.size() > options.sampleLetters) {
+    // Quadgram statistics settle long before the end of a big file, so do
+    // the restarts on a sample and only polish the winner on everything.
+    // The sample gets its share of each budget, and the polish what's left.
+    SolverOptions sampleOptions = options;
+    sampleOptions.sampleLetters = 0;
+    sampleOptions.timeLimit = options.timeLimit * SAMPLE_BUDGET_SHARE;
+    if (options.swapLimit > 0) {
+      sampleOptions.swapLimit =
+          max<uint64_t>(options.swapLimit * SAMPLE_BUDGET_SHARE, 1);
+    }
+    SubstKey sampleKey = solveRestarts(
+        scorer, sampleCiphertext(ciphertext, options.sampleLetters),
+        sampleOptions, budgetLimits(sampleOptions), swaps);
+    limits.swaps -= min(limits.swaps, swaps);
+
+    // Indexing the full text can take longer than the climb, so don't start
+    // on it with no budget left
+    if (limits.reached(0)) {
+      return sampleKey;
+    }
+
+    PhaseTimer timer(solverStats().climbSeconds);
+    uint32_t seed = Random::drawSeed();
+    QuadgramTerms terms(ciphertext, options.scoring);
+    RestartCounters counters;
+    SubstKey key = withRestartRng(seed, 0, options, [&](auto& rng) {
+      return withQuadgramTable(scorer, [&](auto table) {
+        return findBestScore<decltype(table)>(scorer, terms, sampleKey, rng,
+                                              counters, limits);
+      });
+    });
+    CIPHERS_STAT(solverStats().addRestart(counters, terms.score(scorer, key)));
+    return key;
+  }
+
+  return solveRestarts(scorer, ciphertext, options, limits, swaps);
+}
+
+vector<char> decryptSubstCipher(const QuadgramScorer& scorer,
+                                const string& ciphertext,
+                                const SolverOptions& options) {
+  CIPHERS_STAT(solverStats().reset());
+
+  // Clean and encode the text once; the solver never touches strings
+  vector<uint8_t> letters;
+  {
+    PhaseTimer timer(solverStats().cleanSeconds);
+    letters = cleanToIndices(ciphertext);
+  }
+  return fromSubstKey(solveSubstKey(scorer, letters, options));
+}
+
+void decryptSubstCipherCommand(const QuadgramScorer& scorer,
+                               const SolverOptions& options) {
+  cout << "Enter text to decrypt: ";
+  string input;
+  getline(cin, input);
+
+  // Decrypt the text using the best key
+  vector<char> bestKey = decryptSubstCipher(scorer, input, options);
+
+  // Apply the best key to actually decrypt the text
+  string decryptedText;
+  {
+    PhaseTimer timer(solverStats().applySeconds);
+    decryptedText = applySubstCipher(bestKey, input);
+  }
+
+  cout << "Decrypted text: " << decryptedText << endl;
+}
+
+// Reads the letter indices of the file at `path` into `letters`. Only the
+// letters are needed to solve, so this keeps one byte per letter rather than
+// the whole file.
+static bool readFileLetters(const string& path, vector<uint8_t>& letters) {
+  return forEachFileChunk(path, FILE_CHUNK_SIZE, [&](char* chunk, size_t n) {
+    size_t start = letters.size();
+    letters.resize(start + n);
+    letters.resize(start +
+                   compactLetters(chunk, (char*)letters.data() + start, n, 0));
+    return true;
+  });
+}
+
+void decryptSubstFileCommand(const QuadgramScorer& scorer,
+                             const SolverOptions& options) {
+  string inputFile;
+  cout << "Enter input file name: ";
+  getline(cin, inputFile);
+
+  string outputFile;
+  cout << "Enter output file name: ";
+  getline(cin, outputFile);
+
+  CIPHERS_STAT(solverStats().reset());
+
+  vector<uint8_t> letters;
+  bool read;
+  {
+    PhaseTimer timer(solverStats().cleanSeconds);
+    read = readFileLetters(inputFile, letters);
+  }
+  if (!read) {
+    cout << "Couldn't read " << inputFile << endl;
+    return;
+  }
+
+  // Then stream the file through the key, keeping its line breaks and
+  // punctuation
+  SubstKey bestKey = solveSubstKey(scorer, letters, options);
+  PhaseTimer timer(solverStats().applySeconds);
+  if (!applySubstKeyToFile(bestKey, inputFile, outputFile)) {
+    cout << "Couldn't read " << inputFile << " or write " << outputFile
+         << endl;
+  }
+}
+
+#pragma endregion SubstDec
+
+#pragma region Stats
+
+SolverStats& solverStats() {
+  static thread_local SolverStats stats;
+  return stats;
+}
+
+void SolverStats::reset() {
+  double load = loadSeconds;
+  *this = SolverStats();
+  loadSeconds = load;
+}
+
+void SolverStats::addRestart(const RestartCounters& counters, double score) {
+  totals.swapsProposed += counters.swapsProposed;
+  totals.swapsAccepted += counters.swapsAccepted;
+  totals.quadgramsScored += counters.quadgramsScored;
+  totals.cacheLookups += counters.cacheLookups;
+  totals.cacheHits += counters.cacheHits;
+  restarts++;
+  restartScores.push_back(score);
+}
+
+string SolverStats::toJson() const {
+  ostringstream json;
+  json.precision(10);
+  json << "{\"restarts\": " << restarts
+       << ", \"swaps_proposed\": " << totals.swapsProposed
+       << ", \"swaps_accepted\": " << totals.swapsAccepted
+       << ", \"quadgrams_scored\": " << totals.quadgramsScored
+       << ", \"cache_lookups\": " << totals.cacheLookups
+       << ", \"cache_hits\": " << totals.cacheHits
+       << ", \"restart_scores\": [";
+  for (size_t i = 0; i < restartScores.size(); i++) {
+    json << (i > 0 ? ", " : "") << restartScores[i];
+  }
+  json << "], \"seconds\": {\"load\": " << loadSeconds
+       << ", \"clean\": " << cleanSeconds << ", \"climb\": " << climbSeconds
+       << ", \"apply\": " << applySeconds << "}}";
+  return json.str();
+}
+
+string SolverStats::toText() const {
+  ostringstream text;
+  text << "Restarts: " << restarts << endl;
+  text << "Swaps proposed: " << totals.swapsProposed << ", accepted: "
+       << totals.swapsAccepted << endl;
+  text << "Quadgrams scored: " << totals.quadgramsScored << endl;
+  if (totals.cacheLookups > 0) {
+    text << "Score cache hits: " << totals.cacheHits << " of "
+         << totals.cacheLookups << " ("
+         << 100.0 * totals.cacheHits / totals.cacheLookups << "%)" << endl;
+  }
+  if (!restartScores.empty()) {
+    text << "Best restart score: "
+         << *max_element(restartScores.begin(), restartScores.end()) << endl;
+  }
+  text << "Seconds: load " << loadSeconds << ", clean " << cleanSeconds
+       << ", climb " << climbSeconds << ", apply " << applySeconds << endl;
+  return text.str();
+}
+
+void printSolverStatsCommand() {
+#ifdef CIPHERS_NO_STATS
+  cout << "Solver stats were compiled out (CIPHERS_NO_STATS)" << endl;
+#else
+  cout << solverStats().toText();
+#endif
+}
+
+#pragma endregion Stats
+
+#pragma region Server
+
+static void skipJsonSpace(const string& line, size_t& i) {
+  while (i < line.size() && isspace((unsigned char)line[i])) {
+    i++;
+  }
+}
+
+static void appendUtf8(string& out, uint32_t code) {
+  if (code < 0x80) {
+    out += (char)code;
+  } else if (code < 0x800) {
+    out += (char)(0xC0 | code >> 6);
+    out += (char)(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    out += (char)(0xE0 | code >> 12);
+    out += (char)(0x80 | (code >> 6 & 0x3F));
+    out += (char)(0x80 | (code & 0x3F));
+  } else {
+    out += (char)(0xF0 | code >> 18);
+    out += (char)(0x80 | (code >> 12 & 0x3F));
+    out += (char)(0x80 | (code >> 6 & 0x3F));
+    out += (char)(0x80 | (code & 0x3F));
+  }
+}
+
+static uint32_t parseHex4(const string& line, size_t i) {
+  if (i + 4 > line.size()) {
+    throw invalid_argument("Truncated \\u escape");
+  }
+  size_t used = 0;
+  uint32_t code = stoul(line.substr(i, 4), &used, 16);
+  if (used != 4) {
+    throw invalid_argument("Bad \\u escape");
+  }
+  return code;
+}
+
+// Reads the string starting at the quote at `i`, leaving `i` after its
+// closing quote
+static string parseJsonString(const string& line, size_t& i) {
+  string out;
+  for (i++; i < line.size() && line[i] != '"'; i++) {
+    if (line[i] != '\\') {
+      out += line[i];
+      continue;
+    }
+    if (++i == line.size()) {
+      break;
+    }
+    switch (line[i]) {
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u': {
+        uint32_t code = parseHex4(line, i + 1);
+        i += 4;
+        // A surrogate pair spells one code point above U+FFFF
+        if (code >= 0xD800 && code < 0xDC00 && line.compare(i + 1, 2, "\\u") == 0) {
+          uint32_t low = parseHex4(line, i + 3);
+          if (low >= 0xDC00 && low < 0xE000) {
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            i += 6;
+          }
+        }
+        appendUtf8(out, code);
+        break;
+      }
+      default: out += line[i];  // \" \\ and \/
+    }
+  }
+  if (i >= line.size()) {
+    throw invalid_argument("Unterminated string");
+  }
+  i++;
+  return out;
+}
+
+// Whether `text` is a JSON number, `true`, `false` or `null`
+static bool isJsonLiteral(const string& text) {
+  if (text == "true" || text == "false" || text == "null") {
+    return true;
+  }
+  size_t i = text[0] == '-';
+  auto digits = [&] {
+    size_t start = i;
+    while (i < text.size() && isdigit((unsigned char)text[i])) {
+      i++;
+    }
+    return i - start;
+  };
+  // No leading zeros, as in the JSON grammar
+  if (i < text.size() && text[i] == '0') {
+    i++;
+  } else if (digits() == 0) {
+    return false;
+  }
+  if (i < text.size() && text[i] == '.') {
+    i++;
+    if (digits() == 0) {
+      return false;
+    }
+  }
+  if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+    i++;
+    if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+      i++;
+    }
+    if (digits() == 0) {
+      return false;
+    }
+  }
+  return i == text.size();
+}
+
+map<string, JsonValue> parseJsonObject(const string& line) {
+  map<string, JsonValue> fields;
+  size_t i = 0;
+  skipJsonSpace(line, i);
+  if (i == line.size() || line[i] != '{') {
+    throw invalid_argument("Expected a JSON object");
+  }
+  i++;
+  skipJsonSpace(line, i);
+
+  bool first = true;
+  while (i < line.size() && line[i] != '}') {
+    if (!first) {
+      if (line[i] != ',') {
+        throw invalid_argument("Expected , or }");
+      }
+      i++;
+      skipJsonSpace(line, i);
+    }
+    first = false;
+
+    if (i == line.size() || line[i] != '"') {
+      throw invalid_argument("Expected a quoted name");
+    }
+    string name = parseJsonString(line, i);
+    skipJsonSpace(line, i);
+    if (i == line.size() || line[i] != ':') {
+      throw invalid_argument("Expected : after \"" + name + "\"");
+    }
+    i++;
+    skipJsonSpace(line, i);
+
+    JsonValue value;
+    if (i < line.size() && line[i] == '"') {
+      value.text = parseJsonString(line, i);
+      value.isString = true;
+    } else if (i < line.size() && (line[i] == '{' || line[i] == '[')) {
+      throw invalid_argument("Nested values aren't supported: \"" + name +
+                             "\"");
+    } else {
+      // Numbers and literals run to the next separator
+      size_t start = i;
+      while (i < line.size() && line[i] != ',' && line[i] != '}' &&
+             !isspace((unsigned char)line[i])) {
+        i++;
+      }
+      value.text = line.substr(start, i - start);
+      if (value.text.empty()) {
+        throw invalid_argument("Missing value for \"" + name + "\"");
+      }
+      if (!isJsonLiteral(value.text)) {
+        throw invalid_argument("Bad value for \"" + name + "\": " +
+                               value.text);
+      }
+    }
+    fields[name] = value;
+    skipJsonSpace(line, i);
+  }
+
+  if (i == line.size()) {
+    throw invalid_argument("Expected }");
+  }
+  i++;
+  skipJsonSpace(line, i);
+  if (i != line.size()) {
+    throw invalid_argument("Unexpected text after the object");
+  }
+  return fields;
+}
+
+string jsonString(const string& s) {
+  string out = "\"";
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c == '\r') {
+      out += "\\r";
+    } else if (c == '\t') {
+      out += "\\t";
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+static const string& requestField(const map<string, JsonValue>& request,
+                                  const string& name) {
+  auto it = request.find(name);
+  if (it == request.end()) {
+    throw invalid_argument("Missing field: " + name);
+  }
+  return it->second.text;
+}
+
+static vector<char> requestKey(const map<string, JsonValue>& request) {
+  auto it = request.find("key");
+  if (it == request.end()) {
+    return genRandomSubstCipher();
+  }
+
+  // Same rule as the K command: every letter exactly once
+  string key = clean(it->second.text);
+  string sorted = key;
+  sort(sorted.begin(), sorted.end());
+  if (sorted != ALPHABET) {
+    throw invalid_argument("Invalid key: " + it->second.text);
+  }
+  return vector<char>(key.begin(), key.end());
+}
+
+// Runs `f` with the calling thread's `Random` generator seeded with `seed`,
+// then puts the generator back, so a request's seed only decides its own
+// solve and never what later requests on the same worker draw
+template <class F>
+static auto withRequestSeed(int seed, F f) {
+  struct Restore {
+    mt19937 saved = Random::engine();
+    ~Restore() {
+      Random::engine() = saved;
+    }
+  } restore;
+  Random::seed(seed);
+  return f();
+}
+
+string handleRequest(const map<string, JsonValue>& request,
+                     const Dictionary& dict, const QuadgramScorer& scorer,
+                     const SolverOptions& options) {
+  const string& op = requestField(request, "op");
+  const string& text = requestField(request, "text");
+  ostringstream result;
+  result.precision(10);
+
+  if (op == "score") {
+    result << "\"score\": " << scoreString(scorer, clean(text));
+  } else if (op == "caesar_encrypt") {
+    int shift = stoi(requestField(request, "shift"));
+    result << "\"text\": " << jsonString(rot(text, shift));
+  } else if (op == "caesar_decrypt") {
+    // Same steps as caesarDecryptCommand
+    vector<string> cleanedWords;
+    for (const string& word : splitBySpaces(text)) {
+      string cleaned = clean(word);
+      if (!cleaned.empty()) {
+        cleanedWords.push_back(cleaned);
+      }
+    }
+    result << "\"candidates\": [";
+    if (!cleanedWords.empty()) {
+      vector<int> shifts = findCaesarShifts(cleanedWords, dict);
+      for (size_t i = 0; i < shifts.size(); i++) {
+        vector<string> rotatedWords = cleanedWords;
+        rot(rotatedWords, shifts[i]);
+        result << (i > 0 ? ", " : "") << jsonString(joinWithSpaces(rotatedWords));
+      }
+    }
+    result << "]";
+  } else if (op == "subst_encrypt") {
+    vector<char> key = requestKey(request);
+    result << "\"text\": " << jsonString(applySubstCipher(key, text))
+           << ", \"key\": " << jsonString(string(key.begin(), key.end()));
+  } else if (op == "subst_decrypt") {
+    SolverOptions solve = options;
+    if (request.count("restarts")) {
+      solve.restarts = stoi(request.at("restarts").text);
+      if (solve.restarts < 0 || solve.restarts > SERVER_MAX_RESTARTS) {
+        throw invalid_argument("restarts must be 0 to " +
+                               to_string(SERVER_MAX_RESTARTS));
+      }
+    }
+    if (request.count("agree")) {
+      solve.agreeRestarts = stoi(request.at("agree").text);
+    }
+    if (request.count("time_limit")) {
+      solve.timeLimit = stod(request.at("time_limit").text);
+    }
+    auto solveText = [&] { return decryptSubstCipher(scorer, text, solve); };
+    vector<char> key =
+        request.count("seed")
+            ? withRequestSeed(stoi(request.at("seed").text), solveText)
+            : solveText();
+    result << "\"text\": " << jsonString(applySubstCipher(key, text))
+           << ", \"key\": " << jsonString(string(key.begin(), key.end()));
+  } else {
+    throw invalid_argument("Unknown op: " + op);
+  }
+  return result.str();
+}
+
+struct Server::Connection {
+  int fd;
+  mutex writeLock;
+
+  // Requests read but not yet answered, so `serveStream` can wait for them
+  mutex pendingLock;
+  condition_variable idle;
+  size_t pending = 0;
+
+  explicit Connection(int fd) : fd(fd) {}
+};
+
+struct Server::Request {
+  shared_ptr<Connection> connection;
+  chrono::steady_clock::time_point received;
+  string id = "null";  // As JSON
+  string op;
+  map<string, JsonValue> fields;
+  string error;  // Set if the line couldn't be parsed
+
+  // Solves take milliseconds or more; everything else is batched
+  bool isSmall() const {
+    return op != "subst_decrypt";
+  }
+};
+
+Server::Server(const Dictionary& dict, const QuadgramScorer& scorer,
+               const SolverOptions& options)
+    : dict(dict), scorer(scorer), options(options) {
+  // Writes to a client that hung up fail instead of killing the server
+  signal(SIGPIPE, SIG_IGN);
+
+  // The workers are the parallelism; each solve stays on its worker
+  this->options.threads = 1;
+  for (int i = 0; i < max(1, options.threads); i++) {
+    workers.emplace_back([this, i] {
+      Random::seed(time(NULL) + i);
+      work();
+    });
+  }
+}
+
+Server::~Server() {
+  {
+    lock_guard<mutex> lock(queueLock);
+    stopping = true;
+  }
+  queueNotEmpty.notify_all();
+  for (thread& worker : workers) {
+    worker.join();
+  }
+}
+
+void Server::enqueue(Request request) {
+  {
+    lock_guard<mutex> lock(request.connection->pendingLock);
+    request.connection->pending++;
+  }
+
+  unique_lock<mutex> lock(queueLock);
+  if (queue.size() >= SERVER_QUEUE_CAPACITY) {
+    queueFullWaits++;
+    queueNotFull.wait(lock,
+                      [&] { return queue.size() < SERVER_QUEUE_CAPACITY; });
+  }
+  queue.push_back(move(request));
+  lock.unlock();
+  queueNotEmpty.notify_one();
+}
+
+void Server::work() {
+  vector<Request> batch;
+  while (true) {
+    {
+      unique_lock<mutex> lock(queueLock);
+      queueNotEmpty.wait(lock, [&] { return stopping || !queue.empty(); });
+      if (queue.empty()) {
+        return;
+      }
+
+      // One solve, or a run of small requests from the front of the queue
+      do {
+        batch.push_back(move(queue.front()));
+        queue.pop_front();
+      } while (batch.back().isSmall() && batch.size() < SERVER_BATCH_SIZE &&
+               !queue.empty() && queue.front().isSmall());
+    }
+    queueNotFull.notify_all();
+
+    respond(batch);
+    batch.clear();
+  }
+}
+
+void Server::respond(vector<Request>& batch) {
+  // Responses for each connection, in the order they were read
+  vector<pair<Connection*, string>> out;
+  for (Request& request : batch) {
+    bool ok = true;
+    string body;
+    try {
+      if (!request.error.empty()) {
+        throw invalid_argument(request.error);
+      }
+      body = request.op == "metrics"
+                 ? metricsJson()
+                 : handleRequest(request.fields, dict, scorer, options);
+    } catch (const exception& e) {
+      ok = false;
+      body = "\"error\": " + jsonString(e.what());
+    }
+
+    uint64_t micros = chrono::duration_cast<chrono::microseconds>(
+                          chrono::steady_clock::now() - request.received)
+                          .count();
+    record(request.op, ok, micros);
+
+    string line = "{\"id\": " + request.id +
+                  ", \"ok\": " + (ok ? "true" : "false") +
+                  ", \"latency_us\": " + to_string(micros) + ", " + body +
+                  "}\n";
+    Connection* connection = request.connection.get();
+    if (out.empty() || out.back().first != connection) {
+      out.push_back({connection, ""});
+    }
+    out.back().second += line;
+  }
+
+  for (auto& [connection, lines] : out) {
+    {
+      lock_guard<mutex> lock(connection->writeLock);
+      // A client that hung up just misses its responses
+      writeAll(connection->fd, lines.data(), lines.size());
+    }
+    size_t answered = count(lines.begin(), lines.end(), '\n');
+    lock_guard<mutex> lock(connection->pendingLock);
+    connection->pending -= answered;
+    if (connection->pending == 0) {
+      connection->idle.notify_all();
+    }
+  }
+}
+
+void Server::record(const string& op, bool ok, uint64_t micros) {
+  int bucket = micros == 0 ? 0 : 64 - __builtin_clzll(micros);
+  lock_guard<mutex> lock(metricsLock);
+  OpMetrics& opMetrics = metrics[op.empty() ? "invalid" : op];
+  opMetrics.requests++;
+  opMetrics.errors += !ok;
+  opMetrics.maxMicros = max(opMetrics.maxMicros, micros);
+  opMetrics.buckets[min(bucket, LATENCY_BUCKETS - 1)]++;
+}
+
+string Server::metricsJson() {
+  uint64_t fullWaits;
+  {
+    lock_guard<mutex> lock(queueLock);
+    fullWaits = queueFullWaits;
+  }
+
+  lock_guard<mutex> lock(metricsLock);
+  ostringstream json;
+  json << "\"queue_full_waits\": " << fullWaits << ", \"ops\": {";
+  bool first = true;
+  for (const auto& [op, opMetrics] : metrics) {
+    // Upper edge of the bucket holding the given fraction of requests
+    auto percentile = [&](double fraction) {
+      uint64_t seen = 0;
+      for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += opMetrics.buckets[b];
+        if (seen >= fraction * opMetrics.requests) {
+          return min<uint64_t>(1ull << b, opMetrics.maxMicros);
+        }
+      }
+      return opMetrics.maxMicros;
+    };
+    json << (first ? "" : ", ") << jsonString(op)
+         << ": {\"requests\": " << opMetrics.requests
+         << ", \"errors\": " << opMetrics.errors
+         << ", \"p50_us\": " << percentile(0.5)
+         << ", \"p99_us\": " << percentile(0.99)
+         << ", \"max_us\": " << opMetrics.maxMicros << "}";
+    first = false;
+  }
+  json << "}";
+  return json.str();
+}
+
+void Server::serveStream(int inFd, int outFd) {
+  auto connection = make_shared<Connection>(outFd);
+
+  auto handleLine = [&](string line) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.find_first_not_of(" \t") == string::npos) {
+      return;
+    }
+
+    Request request;
+    request.connection = connection;
+    request.received = chrono::steady_clock::now();
+    try {
+      request.fields = parseJsonObject(line);
+      if (request.fields.count("id")) {
+        const JsonValue& id = request.fields["id"];
+        request.id = id.isString ? jsonString(id.text) : id.text;
+      }
+      request.op = requestField(request.fields, "op");
+    } catch (const exception& e) {
+      request.error = e.what();
+    }
+    enqueue(move(request));
+  };
+
+  // A line over the cap is dropped as it comes in, and answered with an
+  // error once its newline arrives
+  char chunk[1 << 16];
+  string partial;
+  bool tooLong = false;
+  auto append = [&](const char* from, size_t size) {
+    if (tooLong || partial.size() + size > SERVER_MAX_LINE_BYTES) {
+      tooLong = true;
+      partial.clear();
+      partial.shrink_to_fit();
+    } else {
+      partial.append(from, size);
+    }
+  };
+  auto endLine = [&] {
+    if (tooLong) {
+      Request request;
+      request.connection = connection;
+      request.received = chrono::steady_clock::now();
+      request.error = "Request longer than " +
+                      to_string(SERVER_MAX_LINE_BYTES) + " bytes";
+      enqueue(move(request));
+    } else {
+      handleLine(move(partial));
+    }
+    partial.clear();
+    tooLong = false;
+  };
+  while (true) {
+    ssize_t got = read(inFd, chunk, sizeof(chunk));
+    if (got < 0 && errno == EINTR) {
+      continue;
+    } else if (got <= 0) {
+      break;
+    }
+
+    size_t start = 0;
+    for (ssize_t i = 0; i < got; i++) {
+      if (chunk[i] == '\n') {
+        append(chunk + start, i - start);
+        endLine();
+        start = i + 1;
+      }
+    }
+    append(chunk + start, got - start);
+  }
+  endLine();
+
+  unique_lock<mutex> lock(connection->pendingLock);
+  connection->idle.wait(lock, [&] { return connection->pending == 0; });
+}
+
+bool Server::serveSocket(const string& path) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  strcpy(address.sun_path, path.c_str());
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    return false;
+  }
+  unlink(path.c_str());
+  if (bind(listener, (sockaddr*)&address, sizeof(address)) < 0 ||
+      listen(listener, SOMAXCONN) < 0) {
+    close(listener);
+    return false;
+  }
+
+  while (true) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      close(listener);
+      return false;
+    }
+    thread([this, client] {
+      serveStream(client, client);
+      close(client);
+    }).detach();
+  }
+}
+
+int serveCommand(const Dictionary& dict, const QuadgramScorer& scorer,
+                 const SolverOptions& options, const string& path) {
+  Server server(dict, scorer, options);
+  if (path.empty()) {
+    server.serveStream(STDIN_FILENO, STDOUT_FILENO);
+    return 0;
+  }
+
+  if (!server.serveSocket(path)) {
+    cerr << "Couldn't listen on " << path << ": "
+         << strerror(errno) << endl;
+  }
+  return 1;
+}
+
+#pragma endregion Server
+
+#pragma region Batch
+
+vector<string> expandInputs(const vector<string>& patterns) {
+  vector<string> inputs;
+  for (const string& pattern : patterns) {
+    glob_t matches;
+    if (pattern.find_first_of("*?[") != string::npos &&
+        glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+      inputs.insert(inputs.end(), matches.gl_pathv,
+                    matches.gl_pathv + matches.gl_pathc);
+      globfree(&matches);
+    } else {
+      inputs.push_back(pattern);
+    }
+  }
+  return inputs;
+}
+
+static size_t fileSize(const string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 ? info.st_size : 0;
+}
+
+BatchSummary batchDecryptFiles(
+    const QuadgramScorer& scorer, const vector<string>& inputs,
+    const string& outputDir, const SolverOptions& options,
+    const function<void(const BatchResult&)>& onResult) {
+  auto batchStart = chrono::steady_clock::now();
+  // An existing directory is fine; any other problem shows up as failed
+  // writes
+  mkdir(outputDir.c_str(), 0777);
+
+  // Seeds are drawn in input order, before anything runs. Outputs are named
+  // after their inputs, so the first input with a file name gets it, and
+  // later ones fail instead of overwriting it.
+  vector<uint32_t> seeds;
+  vector<size_t> sizes;
+  vector<string> outputs;
+  vector<size_t> firstWithName;
+  map<string, size_t> nameUsers;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    seeds.push_back(Random::drawSeed());
+    sizes.push_back(fileSize(inputs[i]));
+    outputs.push_back(outputDir + "/" +
+                      inputs[i].substr(inputs[i].rfind('/') + 1));
+    firstWithName.push_back(nameUsers.emplace(outputs[i], i).first->second);
+  }
+
+  // Start the biggest files first, so the small ones fill in around them
+  // at the end instead of one big file running on alone
+  vector<size_t> order(inputs.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  stable_sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+  BatchSummary summary;
+  summary.files = inputs.size();
+  mutex resultLock;
+  {
+    WorkStealingPool pool(options.threads);
+    for (size_t i : order) {
+      pool.submit([&, i] {
+        auto fileStart = chrono::steady_clock::now();
+        BatchResult result;
+        result.input = inputs[i];
+        result.output = outputs[i];
+
+        vector<uint8_t> letters;
+        if (firstWithName[i] != i) {
+          result.error = "Same file name as " + inputs[firstWithName[i]];
+        } else if (sameFile(inputs[i], outputs[i])) {
+          result.error = "Output would replace the input";
+        } else if (!readFileLetters(inputs[i], letters)) {
+          result.error = "Couldn't read " + inputs[i];
+        } else if (letters.empty()) {
+          result.error = "No letters to solve";
+        } else {
+          // The restarts inside run on the pool's idle workers
+          Random::seed(seeds[i]);
+          CIPHERS_STAT(solverStats().reset());
+          result.key = solveSubstKey(scorer, letters, options);
+          result.letters = letters.size();
+          result.ok =
+              applySubstKeyToFile(result.key, inputs[i], result.output);
+          if (!result.ok) {
+            result.error = "Couldn't write " + result.output;
+          }
+        }
+        result.seconds = chrono::duration<double>(
+                             chrono::steady_clock::now() - fileStart)
+                             .count();
+
+        lock_guard<mutex> lock(resultLock);
+        summary.failed += !result.ok;
+        summary.letters += result.ok ? result.letters : 0;
+        summary.bytes += result.ok ? sizes[i] : 0;
+        onResult(result);
+      });
+    }
+  }
+
+  summary.seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - batchStart)
+          .count();
+  return summary;
+}
+
+string batchResultJson(const BatchResult& result) {
+  ostringstream json;
+  json.precision(6);
+  json << "{\"input\": " << jsonString(result.input)
+       << ", \"output\": " << jsonString(result.output)
+       << ", \"ok\": " << (result.ok ? "true" : "false");
+  if (result.ok) {
+    vector<char> key = fromSubstKey(result.key);
+    json << ", \"letters\": " << result.letters
+         << ", \"seconds\": " << result.seconds
+         << ", \"key\": " << jsonString(string(key.begin(), key.end()));
+  } else {
+    json << ", \"error\": " << jsonString(result.error);
+  }
+  json << "}";
+  return json.str();
+}
+
+string batchSummaryJson(const BatchSummary& summary) {
+  double seconds = max(summary.seconds, 1e-9);
+  ostringstream json;
+  json.precision(6);
+  json << "{\"files\": " << summary.files << ", \"failed\": " << summary.failed
+       << ", \"letters\": " << summary.letters
+       << ", \"seconds\": " << summary.seconds
+       << ", \"files_per_second\": " << summary.files / seconds
+       << ", \"letters_per_second\": " << summary.letters / seconds
+       << ", \"bytes_per_second\": " << summary.bytes / seconds << "}";
+  return json.str();
+}
+
+// One message being hill-climbed in a lane of `solveSubstKeys`
+template <class Engine>
+struct MessageLane {
+  size_t message = SIZE_MAX;  // SIZE_MAX once there are no messages left
+  size_t length = 0;
+  uint32_t restart = 0;
+  Engine rng = restartRng<Engine>(0, 0, 0);
+  // The message's own budgets, as `solveSubstKey` would give it, and the
+  // swaps of its current restart and of the restarts it finished
+  RestartLimits limits;
+  uint64_t restartSwaps = 0;
+  uint64_t swaps = 0;
+  SubstKey warmKey = {};
+  SubstKey key = {};
+  double score = 0;
+  int failedSwaps = 0;
+  SubstKey bestKey = {};
+  double bestScore = 0;
+  int agreeing = 0;
+};
+
+// Hill-climbs messages `order[next++]` in lanes until there are none left.
+// Each restart makes the same draws as `findBestScore`, and stops and moves
+// on under the same rules, but rescores whole texts, so a near tie can round
+// the other way and take a different swap.
+template <class Engine>
+static void climbLanes(const QuadgramScorer& scorer,
+                       const vector<vector<uint8_t>>& messages,
+                       const vector<size_t>& order, atomic<size_t>& next,
+                       uint32_t seed, const SolverOptions& options,
+                       vector<SubstKey>& keys) {
+  const double* table = scorer.table();
+  const int restarts = restartCount(options);
+  array<MessageLane<Engine>, SCORE_LANES> lanes;
+
+  // Interleaved as `scoreSwapLanes` takes them, with every lane padded to
+  // `rows` letters. Padding has cipher letter 26, so it never changes.
+  size_t rows = 0;
+  vector<int32_t> cipher;
+  vector<int32_t> plain;
+  vector<int32_t> trial;
+  int32_t lengths[SCORE_LANES] = {};
+  int32_t letter1[SCORE_LANES] = {};
+  int32_t letter2[SCORE_LANES] = {};
+  int32_t flip[SCORE_LANES] = {};
+  double scores[SCORE_LANES];
+
+  auto startRestart = [&](size_t lane) {
+    MessageLane<Engine>& state = lanes[lane];
+    state.rng = restartRng<Engine>(seed, state.message, state.restart);
+    state.key = startingKey(state.warmKey, state.restart, options, state.rng);
+    state.failedSwaps = 0;
+    state.restartSwaps = 0;
+    state.score = 0;
+    // Summed in the same order as `scoreSwapLanes`, so a key always gets
+    // exactly the same score
+    for (size_t p = 0; p < state.length; p++) {
+      const size_t at = p * SCORE_LANES + lane;
+      plain[at] = state.key[cipher[at]];
+      if (p >= 3) {
+        state.score +=
+            table[((plain[at - 3 * SCORE_LANES] * 26 +
+                    plain[at - 2 * SCORE_LANES]) * 26 +
+                   plain[at - SCORE_LANES]) * 26 + plain[at]];
+      }
+    }
+  };
+
+  auto load = [&](size_t lane) {
+    MessageLane<Engine>& state = lanes[lane];
+    size_t i = next++;
+    state.message = i < order.size() ? order[i] : SIZE_MAX;
+    state.length = i < order.size() ? messages[state.message].size() : 0;
+    lengths[lane] = state.length;
+    if (state.length > rows) {
+      rows = state.length;
+      cipher.resize(rows * SCORE_LANES, 26);
+      plain.resize(rows * SCORE_LANES, 0);
+      trial.resize(rows * SCORE_LANES, 0);
+    }
+    for (size_t p = 0; p < rows; p++) {
+      const size_t at = p * SCORE_LANES + lane;
+      cipher[at] = p < state.length ? messages[state.message][p] : 26;
+      plain[at] = 0;
+    }
+    if (state.length == 0) {
+      return;
+    }
+
+    state.warmKey = frequencyKey(messages[state.message]);
+    state.limits = budgetLimits(options);
+    state.swaps = 0;
+    state.restart = 0;
+    state.bestScore = -numeric_limits<double>::infinity();
+    state.agreeing = 0;
+    startRestart(lane);
+  };
+
+  auto finishRestart = [&](size_t lane) {
+    MessageLane<Engine>& state = lanes[lane];
+    // Ties go to the earliest restart, as in `bestRestart`
+    if (state.score > state.bestScore) {
+      state.bestScore = state.score;
+      state.bestKey = state.key;
+      state.agreeing = 1;
+    } else if (state.score == state.bestScore) {
+      state.agreeing++;
+    }
+    state.restart++;
+    state.swaps += state.restartSwaps;
+    if (state.restart == (uint32_t)restarts ||
+        (options.agreeRestarts > 0 &&
+         state.agreeing >= options.agreeRestarts) ||
+        (options.swapLimit > 0 && state.swaps >= options.swapLimit) ||
+        state.limits.reached(0)) {
+      keys[state.message] = state.bestKey;
+      load(lane);
+    } else {
+      startRestart(lane);
+    }
+  };
+
+  for (size_t lane = 0; lane < SCORE_LANES; lane++) {
+    load(lane);
+  }
+  while (true) {
+    size_t length = 0;
+    for (size_t lane = 0; lane < SCORE_LANES; lane++) {
+      MessageLane<Engine>& state = lanes[lane];
+      // A restart out of budget keeps the best key it found, as in
+      // `findBestScore`; the next one may be skipped
+      while (state.length > 0 && state.limits.reached(state.restartSwaps)) {
+        finishRestart(lane);
+      }
+      length = max(length, state.length);
+      if (state.length == 0) {
+        flip[lane] = 0;
+        continue;
+      }
+      letter1[lane] = Random::randInt(state.rng, 25);
+      do {
+        letter2[lane] = Random::randInt(state.rng, 25);
+      } while (letter2[lane] == letter1[lane]);
+      flip[lane] = state.key[letter1[lane]] ^ state.key[letter2[lane]];
+      state.restartSwaps++;
+    }
+    if (length == 0) {
+      return;
+    }
+
+    scoreSwapLanes(table, cipher.data(), plain.data(), trial.data(), length,
+                   lengths, letter1, letter2, flip, scores);
+
+    for (size_t lane = 0; lane < SCORE_LANES; lane++) {
+      MessageLane<Engine>& state = lanes[lane];
+      if (state.length == 0) {
+        continue;
+      }
+      if (scores[lane] > state.score) {
+        swap(state.key[letter1[lane]], state.key[letter2[lane]]);
+        state.score = scores[lane];
+        state.failedSwaps = 0;
+        for (size_t p = 0; p < state.length; p++) {
+          plain[p * SCORE_LANES + lane] = trial[p * SCORE_LANES + lane];
+        }
+      } else if (++state.failedSwaps >= 1000) {
+        finishRestart(lane);
+      }
+    }
+  }
+}
+
+vector<SubstKey> solveSubstKeys(const QuadgramScorer& scorer,
+                                const vector<vector<uint8_t>>& messages,
+                                const SolverOptions& options) {
+  uint32_t seed = Random::drawSeed();
+  vector<SubstKey> keys(messages.size());
+
+  if (options.engine != SolverEngine::HillClimb) {
+    parallelFor(messages.size(), options.threads, [&](size_t i) {
+      SolverOptions job = options;
+      job.job = i;
+      QuadgramTerms terms(messages[i], options.scoring);
+      vector<RestartResult> results;
+      for (int restart = 0; restart < restartCount(options); restart++) {
+        results.push_back(
+            solveSubstRestart(scorer, messages[i], terms, seed, restart, job));
+      }
+      keys[i] = bestRestart(results);
+    });
+    return keys;
+  }
+
+  // Every key scores 0 on a message with no quadgrams, so it keeps the
+  // starting key of its first restart, as it would in `solveSubstKey`
+  withRngType(options, [&](auto* type) {
+    using Engine = remove_pointer_t<decltype(type)>;
+    vector<size_t> order;
+    for (size_t i = 0; i < messages.size(); i++) {
+      if (messages[i].size() < 4) {
+        Engine rng = restartRng<Engine>(seed, i, 0);
+        keys[i] = startingKey(frequencyKey(messages[i]), 0, options, rng);
+      } else {
+        order.push_back(i);
+      }
+    }
+
+    // Neighbours in length share lanes, so few lanes idle on padding
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return messages[a].size() < messages[b].size();
+    });
+
+    atomic<size_t> next(0);
+    size_t workers = min<size_t>(
+        max(options.threads, 1), (order.size() + SCORE_LANES - 1) / SCORE_LANES);
+    parallelFor(workers, workers, [&](size_t) {
+      climbLanes<Engine>(scorer, messages, order, next, seed, options, keys);
+    });
+  });
+  return keys;
+}
+
+vector<vector<char>> decryptSubstCiphers(const QuadgramScorer& scorer,
+                                         const vector<string>& ciphertexts,
+                                         const SolverOptions& options) {
+  vector<vector<uint8_t>> messages;
+  messages.reserve(ciphertexts.size());
+  for (const string& ciphertext : ciphertexts) {
+    messages.push_back(cleanToIndices(ciphertext));
+  }
+
+  vector<vector<char>> keys;
+  keys.reserve(ciphertexts.size());
+  for (const SubstKey& key : solveSubstKeys(scorer, messages, options)) {
+    keys.push_back(fromSubstKey(key));
+  }
+  return keys;
+}
+
+void batchDecryptCommand(const QuadgramScorer& scorer,
+                         const SolverOptions& options) {
+  string patterns;
+  cout << "Enter input files (globs allowed): ";
+  getline(cin, patterns);
+
+  string outputDir;
+  cout << "Enter output directory: ";
+  getline(cin, outputDir);
+
+  vector<string> inputs = expandInputs(splitBySpaces(patterns));
+  BatchSummary summary = batchDecryptFiles(
+      scorer, inputs, outputDir, options, [](const BatchResult& result) {
+        if (result.ok) {
+          cout << "Decrypted " << result.input << " to " << result.output
+               << " (" << result.letters << " letters, " << result.seconds
+               << " s)" << endl;
+        } else {
+          cout << "Failed " << result.input << ": " << result.error << endl;
+        }
+      });
+
+  cout << summary.files << " files, " << summary.failed << " failed, "
+       << summary.letters << " letters in " << summary.seconds << " s"
+       << endl;
+}
+
+int batchCommand(const QuadgramScorer& scorer, const vector<string>& inputs,
+                 const string& outputDir, const SolverOptions& options) {
+  BatchSummary summary = batchDecryptFiles(
+      scorer, expandInputs(inputs), outputDir, options,
+      [](const BatchResult& result) {
+        cout << batchResultJson(result) << endl;
+      });
+  cout << batchSummaryJson(summary) << endl;
+  return summary.failed == 0 ? 0 : 1;
+}
+
+#pragma endregion Batch
+
+#pragma region Kernels
+
+// Letters map to 0-25 and everything else to 26 or more, in either case
+static inline unsigned letterIndex(unsigned char c) {
+  return (unsigned char)((c | 0x20) - 'a');
+}
+
+static inline bool isSpaceByte(unsigned char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static void translateLettersScalar(const char table[26], const char* in,
+                                   char* out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    unsigned idx = letterIndex(in[i]);
+    out[i] = idx < 26 ? table[idx] : in[i];
+  }
+}
+
+static size_t translateWordsScalar(const char table[26], const char* in,
+                                   char* out, size_t n) {
+  size_t written = 0;
+  for (size_t i = 0; i < n; i++) {
+    unsigned idx = letterIndex(in[i]);
+    if (idx < 26) {
+      out[written++] = table[idx];
+    } else if (isSpaceByte(in[i])) {
+      out[written++] = ' ';
+    }
+  }
+  return written;
+}
+
+static size_t compactLettersScalar(const char* in, char* out, size_t n,
+                                   char base) {
+  // Always write, but only advance past letters, so there's no branch to
+  // mispredict on punctuation
+  size_t written = 0;
+  for (size_t i = 0; i < n; i++) {
+    unsigned idx = letterIndex(in[i]);
+    out[written] = (char)(base + idx);
+    written += idx < 26;
+  }
+  return written;
+}
+
+static void scoreSwapLanesScalar(const double* table, const int32_t* cipher,
+                                 const int32_t* plain, int32_t* trial,
+                                 size_t length, const int32_t lengths[],
+                                 const int32_t letter1[],
+                                 const int32_t letter2[], const int32_t flip[],
+                                 double scores[]) {
+  for (size_t lane = 0; lane < SCORE_LANES; lane++) {
+    scores[lane] = 0;
+    for (size_t p = 0; p < length; p++) {
+      const size_t at = p * SCORE_LANES + lane;
+      int32_t c = cipher[at];
+      bool hit = c == letter1[lane] || c == letter2[lane];
+      trial[at] = plain[at] ^ (hit ? flip[lane] : 0);
+      if (p >= 3 && (int32_t)p < lengths[lane]) {
+        scores[lane] += table[((trial[at - 3 * SCORE_LANES] * 26 +
+                                trial[at - 2 * SCORE_LANES]) * 26 +
+                               trial[at - SCORE_LANES]) * 26 + trial[at]];
+      }
+    }
+  }
+}
+
+#if defined(__x86_64__)
+
+// Each SIMD block computes the letter index of every byte, looks it up in
+// the low (0-15) and high (16-25) halves of the table with a byte shuffle,
+// and blends the letters back over the input. Bytes that aren't letters or
+// whitespace are rare in prose, so `translateWords` stores whole blocks and
+// only compacts the few blocks that contain one.
+
+__attribute__((target("sse4.1"))) static inline __m128i translateBlockSse41(
+    __m128i v, __m128i lo, __m128i hi, __m128i* isLetter) {
+  __m128i idx = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+                             _mm_set1_epi8('a'));
+  *isLetter = _mm_cmpeq_epi8(_mm_min_epu8(idx, _mm_set1_epi8(25)), idx);
+  __m128i isLow = _mm_cmpeq_epi8(_mm_min_epu8(idx, _mm_set1_epi8(15)), idx);
+  __m128i mapped = _mm_blendv_epi8(
+      _mm_shuffle_epi8(hi, _mm_sub_epi8(idx, _mm_set1_epi8(16))),
+      _mm_shuffle_epi8(lo, idx), isLow);
+  return _mm_blendv_epi8(v, mapped, *isLetter);
+}
+
+// Whitespace is ' ' or '\t' through '\r'
+__attribute__((target("sse4.1"))) static inline __m128i isSpaceSse41(
+    __m128i v) {
+  __m128i fromTab = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+  return _mm_or_si128(
+      _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+      _mm_cmpeq_epi8(_mm_min_epu8(fromTab, _mm_set1_epi8('\r' - '\t')),
+                     fromTab));
+}
+
+__attribute__((target("sse4.1"))) static void loadTableSse41(
+    const char table[26], __m128i* lo, __m128i* hi) {
+  char high[16] = {0};
+  memcpy(high, table + 16, 10);
+  *lo = _mm_loadu_si128((const __m128i*)table);
+  *hi = _mm_loadu_si128((const __m128i*)high);
+}
+
+__attribute__((target("sse4.1"))) static void translateLettersSse41(
+    const char table[26], const char* in, char* out, size_t n) {
+  __m128i lo, hi, isLetter;
+  loadTableSse41(table, &lo, &hi);
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+    _mm_storeu_si128((__m128i*)(out + i),
+                     translateBlockSse41(v, lo, hi, &isLetter));
+  }
+  translateLettersScalar(table, in + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.1"))) static size_t translateWordsSse41(
+    const char table[26], const char* in, char* out, size_t n) {
+  __m128i lo, hi, isLetter;
+  loadTableSse41(table, &lo, &hi);
+
+  size_t i = 0;
+  size_t written = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+    __m128i result = translateBlockSse41(v, lo, hi, &isLetter);
+    __m128i isSpace = isSpaceSse41(v);
+    result = _mm_blendv_epi8(result, _mm_set1_epi8(' '), isSpace);
+    unsigned keep = (unsigned)_mm_movemask_epi8(_mm_or_si128(isLetter, isSpace));
+
+    if (keep == 0xFFFFu) {
+      _mm_storeu_si128((__m128i*)(out + written), result);
+      written += 16;
+    } else {
+      alignas(16) char block[16];
+      _mm_store_si128((__m128i*)block, result);
+      for (; keep != 0; keep &= keep - 1) {
+        out[written++] = block[__builtin_ctz(keep)];
+      }
+    }
+  }
+  return written + translateWordsScalar(table, in + i, out + written, n - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i translateBlockAvx2(
+    __m256i v, __m256i lo, __m256i hi, __m256i* isLetter) {
+  __m256i idx = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)),
+                                _mm256_set1_epi8('a'));
+  *isLetter =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(idx, _mm256_set1_epi8(25)), idx);
+  __m256i isLow =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(idx, _mm256_set1_epi8(15)), idx);
+  __m256i mapped = _mm256_blendv_epi8(
+      _mm256_shuffle_epi8(hi, _mm256_sub_epi8(idx, _mm256_set1_epi8(16))),
+      _mm256_shuffle_epi8(lo, idx), isLow);
+  return _mm256_blendv_epi8(v, mapped, *isLetter);
+}
+
+__attribute__((target("avx2"))) static inline __m256i isSpaceAvx2(__m256i v) {
+  __m256i fromTab = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+  return _mm256_or_si256(
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+      _mm256_cmpeq_epi8(
+          _mm256_min_epu8(fromTab, _mm256_set1_epi8('\r' - '\t')), fromTab));
+}
+
+__attribute__((target("avx2"))) static void loadTableAvx2(const char table[26],
+                                                          __m256i* lo,
+                                                          __m256i* hi) {
+  char high[16] = {0};
+  memcpy(high, table + 16, 10);
+  // Shuffles only look within each 128-bit lane, so copy the table to both
+  *lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table));
+  *hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)high));
+}
+
+__attribute__((target("avx2"))) static void translateLettersAvx2(
+    const char table[26], const char* in, char* out, size_t n) {
+  __m256i lo, hi, isLetter;
+  loadTableAvx2(table, &lo, &hi);
+
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+    _mm256_storeu_si256((__m256i*)(out + i),
+                        translateBlockAvx2(v, lo, hi, &isLetter));
+  }
+  translateLettersScalar(table, in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t translateWordsAvx2(
+    const char table[26], const char* in, char* out, size_t n) {
+  __m256i lo, hi, isLetter;
+  loadTableAvx2(table, &lo, &hi);
+
+  size_t i = 0;
+  size_t written = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+    __m256i result = translateBlockAvx2(v, lo, hi, &isLetter);
+
+    __m256i isSpace = isSpaceAvx2(v);
+    result = _mm256_blendv_epi8(result, _mm256_set1_epi8(' '), isSpace);
+    unsigned keep =
+        (unsigned)_mm256_movemask_epi8(_mm256_or_si256(isLetter, isSpace));
+
+    if (keep == 0xFFFFFFFFu) {
+      _mm256_storeu_si256((__m256i*)(out + written), result);
+      written += 32;
+    } else {
+      alignas(32) char block[32];
+      _mm256_store_si256((__m256i*)block, result);
+      for (; keep != 0; keep &= keep - 1) {
+        out[written++] = block[__builtin_ctz(keep)];
+      }
+    }
+  }
+  return written + translateWordsScalar(table, in + i, out + written, n - i);
+}
+
+// Shuffle that moves the bytes selected by an 8-bit mask to the front
+static constexpr array<array<uint8_t, 8>, 256> COMPACT_SHUFFLES = [] {
+  array<array<uint8_t, 8>, 256> shuffles{};
+  for (int mask = 0; mask < 256; mask++) {
+    int next = 0;
+    for (int bit = 0; bit < 8; bit++) {
+      if (mask & (1 << bit)) {
+        shuffles[mask][next++] = bit;
+      }
+    }
+  }
+  return shuffles;
+}();
+
+// Compacts one 16-byte block of letter codes with two 8-byte shuffles.
+// Each store writes a full 8 bytes, which stays inside the part of `out`
+// the block is allowed to fill
+__attribute__((target("sse4.1"))) static inline size_t compactBlockSse41(
+    __m128i codes, unsigned keep, char* out) {
+  __m128i shuffle = _mm_loadl_epi64((const __m128i*)&COMPACT_SHUFFLES[keep & 0xFF]);
+  _mm_storel_epi64((__m128i*)out, _mm_shuffle_epi8(codes, shuffle));
+  size_t written = __builtin_popcount(keep & 0xFF);
+
+  shuffle = _mm_loadl_epi64((const __m128i*)&COMPACT_SHUFFLES[keep >> 8]);
+  _mm_storel_epi64((__m128i*)(out + written),
+                   _mm_shuffle_epi8(_mm_srli_si128(codes, 8), shuffle));
+  return written + __builtin_popcount(keep >> 8);
+}
+
+__attribute__((target("sse4.1"))) static inline __m128i letterCodesSse41(
+    __m128i v, char base, unsigned* keep) {
+  __m128i idx = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+                             _mm_set1_epi8('a'));
+  *keep = (unsigned)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_min_epu8(idx, _mm_set1_epi8(25)), idx));
+  return _mm_add_epi8(idx, _mm_set1_epi8(base));
+}
+
+__attribute__((target("sse4.1"))) static size_t compactLettersSse41(
+    const char* in, char* out, size_t n, char base) {
+  size_t i = 0;
+  size_t written = 0;
+  for (; i + 16 <= n; i += 16) {
+    unsigned keep;
+    __m128i codes = letterCodesSse41(
+        _mm_loadu_si128((const __m128i*)(in + i)), base, &keep);
+    written += compactBlockSse41(codes, keep, out + written);
+  }
+  return written + compactLettersScalar(in + i, out + written, n - i, base);
+}
+
+__attribute__((target("avx2"))) static size_t compactLettersAvx2(
+    const char* in, char* out, size_t n, char base) {
+  size_t i = 0;
+  size_t written = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+    __m256i idx = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)),
+                                  _mm256_set1_epi8('a'));
+    unsigned keep = (unsigned)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(idx, _mm256_set1_epi8(25)), idx));
+    __m256i codes = _mm256_add_epi8(idx, _mm256_set1_epi8(base));
+
+    // Blocks of nothing but letters are common in ciphertext without spaces
+    if (keep == 0xFFFFFFFFu) {
+      _mm256_storeu_si256((__m256i*)(out + written), codes);
+      written += 32;
+      continue;
+    }
+    written += compactBlockSse41(_mm256_castsi256_si128(codes), keep & 0xFFFF,
+                                 out + written);
+    written += compactBlockSse41(_mm256_extracti128_si256(codes, 1),
+                                 keep >> 16, out + written);
+  }
+  return written + compactLettersScalar(in + i, out + written, n - i, base);
+}
+
+// VBMI2 compresses a whole 64-byte block in one instruction
+__attribute__((target("avx512f,avx512bw,avx512vbmi2"))) static size_t
+compactLettersAvx512(const char* in, char* out, size_t n, char base) {
+  size_t i = 0;
+  size_t written = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m512i v = _mm512_loadu_si512(in + i);
+    __m512i idx = _mm512_sub_epi8(_mm512_or_si512(v, _mm512_set1_epi8(0x20)),
+                                  _mm512_set1_epi8('a'));
+    __mmask64 keep = _mm512_cmplt_epu8_mask(idx, _mm512_set1_epi8(26));
+    __m512i codes = _mm512_add_epi8(idx, _mm512_set1_epi8(base));
+    _mm512_storeu_si512(out + written, _mm512_maskz_compress_epi8(keep, codes));
+    written += __builtin_popcountll(keep);
+  }
+  return written + compactLettersScalar(in + i, out + written, n - i, base);
+}
+
+// Eight lanes of 32-bit letters fill one register. The trial letters and
+// quadgram indices are computed a row at a time, and each row's quadgrams
+// are gathered from the double table, masked to the lanes whose text is that
+// long. Masked lanes add zero, so every lane sums the same values in the
+// same order as the scalar version.
+__attribute__((target("avx2"))) static inline __m256i trialRowAvx2(
+    const int32_t* cipher, const int32_t* plain, int32_t* trial,
+    __m256i letter1, __m256i letter2, __m256i flip) {
+  __m256i c = _mm256_loadu_si256((const __m256i*)cipher);
+  __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi32(c, letter1),
+                                _mm256_cmpeq_epi32(c, letter2));
+  __m256i row = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)plain),
+                                 _mm256_and_si256(hit, flip));
+  _mm256_storeu_si256((__m256i*)trial, row);
+  return row;
+}
+
+__attribute__((target("avx2"))) static inline __m256i quadgramIndexAvx2(
+    __m256i q0, __m256i q1, __m256i q2, __m256i q3) {
+  return _mm256_add_epi32(
+      _mm256_add_epi32(_mm256_mullo_epi32(q0, _mm256_set1_epi32(26 * 26 * 26)),
+                       _mm256_mullo_epi32(q1, _mm256_set1_epi32(26 * 26))),
+      _mm256_add_epi32(_mm256_mullo_epi32(q2, _mm256_set1_epi32(26)), q3));
+}
+
+__attribute__((target("avx2"))) static void scoreSwapLanesAvx2(
+    const double* table, const int32_t* cipher, const int32_t* plain,
+    int32_t* trial, size_t length, const int32_t lengths[],
+    const int32_t letter1[], const int32_t letter2[], const int32_t flip[],
+    double scores[]) {
+  static_assert(SCORE_LANES == 8, "One register holds every lane");
+  const __m256i first = _mm256_loadu_si256((const __m256i*)letter1);
+  const __m256i second = _mm256_loadu_si256((const __m256i*)letter2);
+  const __m256i flips = _mm256_loadu_si256((const __m256i*)flip);
+  const __m256i ends = _mm256_loadu_si256((const __m256i*)lengths);
+  // The last three trial letters of every lane
+  __m256i q0 = _mm256_setzero_si256();
+  __m256i q1 = _mm256_setzero_si256();
+  __m256i q2 = _mm256_setzero_si256();
+  __m256d sumLow = _mm256_setzero_pd();
+  __m256d sumHigh = _mm256_setzero_pd();
+  for (size_t p = 0; p < length; p++) {
+    const size_t row = p * SCORE_LANES;
+    __m256i q3 = trialRowAvx2(cipher + row, plain + row, trial + row, first,
+                              second, flips);
+    if (p >= 3) {
+      __m256i idx = quadgramIndexAvx2(q0, q1, q2, q3);
+      __m256i valid = _mm256_cmpgt_epi32(ends, _mm256_set1_epi32((int)p));
+      __m256d maskLow = _mm256_castsi256_pd(
+          _mm256_cvtepi32_epi64(_mm256_castsi256_si128(valid)));
+      __m256d maskHigh = _mm256_castsi256_pd(
+          _mm256_cvtepi32_epi64(_mm256_extracti128_si256(valid, 1)));
+      sumLow = _mm256_add_pd(
+          sumLow, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table,
+                                           _mm256_castsi256_si128(idx),
+                                           maskLow, 8));
+      sumHigh = _mm256_add_pd(
+          sumHigh, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table,
+                                            _mm256_extracti128_si256(idx, 1),
+                                            maskHigh, 8));
+    }
+    q0 = q1;
+    q1 = q2;
+    q2 = q3;
+  }
+  _mm256_storeu_pd(scores, sumLow);
+  _mm256_storeu_pd(scores + 4, sumHigh);
+}
+
+// AVX-512 gathers all eight lanes' doubles in one instruction
+__attribute__((target("avx512f,avx2"))) static void scoreSwapLanesAvx512(
+    const double* table, const int32_t* cipher, const int32_t* plain,
+    int32_t* trial, size_t length, const int32_t lengths[],
+    const int32_t letter1[], const int32_t letter2[], const int32_t flip[],
+    double scores[]) {
+  const __m256i first = _mm256_loadu_si256((const __m256i*)letter1);
+  const __m256i second = _mm256_loadu_si256((const __m256i*)letter2);
+  const __m256i flips = _mm256_loadu_si256((const __m256i*)flip);
+  const __m256i ends = _mm256_loadu_si256((const __m256i*)lengths);
+  __m256i q0 = _mm256_setzero_si256();
+  __m256i q1 = _mm256_setzero_si256();
+  __m256i q2 = _mm256_setzero_si256();
+  __m512d sum = _mm512_setzero_pd();
+  for (size_t p = 0; p < length; p++) {
+    const size_t row = p * SCORE_LANES;
+    __m256i q3 = trialRowAvx2(cipher + row, plain + row, trial + row, first,
+                              second, flips);
+    if (p >= 3) {
+      __mmask8 valid = _mm256_movemask_ps(_mm256_castsi256_ps(
+          _mm256_cmpgt_epi32(ends, _mm256_set1_epi32((int)p))));
+      sum = _mm512_add_pd(
+          sum, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), valid,
+                                        quadgramIndexAvx2(q0, q1, q2, q3),
+                                        table, 8));
+    }
+    q0 = q1;
+    q1 = q2;
+    q2 = q3;
+  }
+  _mm512_storeu_pd(scores, sum);
+}
+
+#endif
+
+SimdLevel bestSimdLevel() {
+#if defined(__x86_64__)
+  static const SimdLevel level = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vbmi2")) {
+      return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+      return SimdLevel::SSE41;
+    }
+    return SimdLevel::Scalar;
+  }();
+  return level;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+void translateLetters(const char table[26], const char* in, char* out,
+                      size_t n, SimdLevel level) {
+#if defined(__x86_64__)
+  level = min(level, bestSimdLevel());
+  if (level >= SimdLevel::AVX2) {
+    return translateLettersAvx2(table, in, out, n);
+  }
+  if (level == SimdLevel::SSE41) {
+    return translateLettersSse41(table, in, out, n);
+  }
+#endif
+  translateLettersScalar(table, in, out, n);
+}
+
+size_t translateWords(const char table[26], const char* in, char* out,
+                      size_t n, SimdLevel level) {
+#if defined(__x86_64__)
+  level = min(level, bestSimdLevel());
+  if (level >= SimdLevel::AVX2) {
+    return translateWordsAvx2(table, in, out, n);
+  }
+  if (level == SimdLevel::SSE41) {
+    return translateWordsSse41(table, in, out, n);
+  }
+#endif
+  return translateWordsScalar(table, in, out, n);
+}
+
+size_t compactLetters(const char* in, char* out, size_t n, char base,
+                      SimdLevel level) {
+#if defined(__x86_64__)
+  level = min(level, bestSimdLevel());
+  if (level == SimdLevel::AVX512) {
+    return compactLettersAvx512(in, out, n, base);
+  }
+  if (level == SimdLevel::AVX2) {
+    return compactLettersAvx2(in, out, n, base);
+  }
+  if (level == SimdLevel::SSE41) {
+    return compactLettersSse41(in, out, n, base);
+  }
+#endif
+  return compactLettersScalar(in, out, n, base);
+}
+
+void scoreSwapLanes(const double* table, const int32_t* cipher,
+                    const int32_t* plain, int32_t* trial, size_t length,
+                    const int32_t lengths[], const int32_t letter1[],
+                    const int32_t letter2[], const int32_t flip[],
+                    double scores[], SimdLevel level) {
+#if defined(__x86_64__)
+  level = min(level, bestSimdLevel());
+  if (level == SimdLevel::AVX512) {
+    return scoreSwapLanesAvx512(table, cipher, plain, trial, length, lengths,
+                                letter1, letter2, flip, scores);
+  }
+  if (level == SimdLevel::AVX2) {
+    return scoreSwapLanesAvx2(table, cipher, plain, trial, length, lengths,
+                              letter1, letter2, flip, scores);
+  }
+#endif
+  scoreSwapLanesScalar(table, cipher, plain, trial, length, lengths, letter1,
+                       letter2, flip, scores);
+}
+
+#pragma endregion Kernels
+
+#pragma region Pool
+
+WorkStealingPool*& WorkStealingPool::currentPool() {
+  static thread_local WorkStealingPool* pool = nullptr;
+  return pool;
+}
+
+size_t& WorkStealingPool::currentIndex() {
+  static thread_local size_t index = 0;
+  return index;
+}
+
+bool WorkStealingPool::take(size_t index, function<void()>& task) {
+  for (size_t i = 0; i < queues.size(); i++) {
+    Queue& queue = *queues[(index + i) % queues.size()];
+    lock_guard<mutex> lock(queue.lock);
+    if (!queue.tasks.empty()) {
+      if (i == 0) {
+        task = move(queue.tasks.front());
+        queue.tasks.pop_front();
+      } else {
+        task = move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::work(size_t index) {
+  currentPool() = this;
+  currentIndex() = index;
+  function<void()> task;
+  while (true) {
+    {
+      unique_lock<mutex> lock(stateLock);
+      workAvailable.wait(lock, [&] { return stopping || queued > 0; });
+      if (queued == 0) {
+        return;
+      }
+      queued--;
+    }
+
+    // `queued` counted this task in, so some queue still holds it
+    while (!take(index, task)) {
+      this_thread::yield();
+    }
+    task();
+    task = nullptr;
+
+    lock_guard<mutex> lock(stateLock);
+    if (--unfinished == 0) {
+      allDone.notify_all();
+    }
+  }
+}
+
+WorkStealingPool::WorkStealingPool(int threads) {
+  threads = max(threads, 1);
+  for (int i = 0; i < threads; i++) {
+    queues.push_back(make_unique<Queue>());
+  }
+  for (int i = 0; i < threads; i++) {
+    this->threads.emplace_back([this, i] { work(i); });
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  wait();
+  {
+    lock_guard<mutex> lock(stateLock);
+    stopping = true;
+  }
+  workAvailable.notify_all();
+  for (thread& t : threads) {
+    t.join();
+  }
+}
+
+void WorkStealingPool::submit(function<void()> task) {
+  size_t index = currentPool() == this ? currentIndex()
+                                       : nextQueue++ % queues.size();
+  {
+    lock_guard<mutex> lock(queues[index]->lock);
+    queues[index]->tasks.push_back(move(task));
+  }
+  {
+    lock_guard<mutex> lock(stateLock);
+    unfinished++;
+    queued++;
+  }
+  workAvailable.notify_one();
+}
+
+void WorkStealingPool::wait() {
+  unique_lock<mutex> lock(stateLock);
+  allDone.wait(lock, [&] { return unfinished == 0; });
+}
+
+WorkStealingPool& sharedPool() {
+  static WorkStealingPool pool(max(1u, thread::hardware_concurrency()));
+  return pool;
+}
+
+#pragma endregion Pool
+
+#pragma region FileIO
+
+bool writeAll(int fd, const char* data, size_t n) {
+  while (n > 0) {
+    ssize_t put = write(fd, data, n);
+    if (put < 0 && errno != EINTR) {
+      return false;
+    }
+    if (put > 0) {
+      data += put;
+      n -= put;
+    }
+  }
+  return true;
+}
+
+bool replaceFile(const string& path, const function<bool(int)>& write) {
+  string temp = path + ".XXXXXX";
+  int fd = mkstemp(temp.data());
+  if (fd < 0) {
+    return false;
+  }
+
+  // mkstemp makes the file private; give it the mode a new file would get
+  bool ok = fchmod(fd, 0644) == 0 && write(fd);
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool sameFile(const string& a, const string& b) {
+  struct stat statA;
+  struct stat statB;
+  return stat(a.c_str(), &statA) == 0 && stat(b.c_str(), &statB) == 0 &&
+         statA.st_dev == statB.st_dev && statA.st_ino == statB.st_ino;
+}
+
+#pragma endregion FileIO
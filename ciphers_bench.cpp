@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "include/batch.h"
+#include "include/caesar_dec.h"
+#include "include/caesar_enc.h"
+#include "include/subst_dec.h"
+#include "include/subst_enc.h"
+#include "utils.h"
+
+using namespace std;
+
+// Microbenchmarks for the hot paths of ciphers_main, built with optimizations
+// and without sanitizers. Prints one JSON object per benchmark and line, so
+// results can be collected and compared across releases:
+//
+//   {"name": "rot", "iterations": 4096, "ns_per_op": 1234.5,
+//    "bytes_per_second": 3.7e9}
+//
+// `bytes_per_second` is present when a benchmark has an input size,
+// `swaps_per_second` when it counts solver swaps, and `messages_per_second`
+// when it solves many messages per call.
+//
+// Usage: ciphers_bench [--filter=SUBSTRING] [--min-time=SECONDS]
+
+namespace {
+
+// Keeps the optimizer from dropping work whose result is never used
+template <class T>
+void keep(const T& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+string readFile(const string& path) {
+  ifstream file(path);
+  stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+struct Benchmark {
+  string name;
+  // Input bytes and solver swaps per call of `run`, or 0 if not meaningful
+  size_t bytes;
+  size_t swaps;
+  function<void()> run;
+  size_t messages = 0;
+};
+
+// Times `benchmark.run` in batches that each take at least a fifth of
+// `minTime`, and reports the median batch
+void measure(const Benchmark& benchmark, double minTime) {
+  using Clock = chrono::steady_clock;
+  auto timeBatch = [&](size_t iterations) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+      benchmark.run();
+    }
+    return chrono::duration<double>(Clock::now() - start).count();
+  };
+
+  // Double the batch until it's long enough to time reliably
+  size_t iterations = 1;
+  while (timeBatch(iterations) < minTime / 5 && iterations < (1u << 30)) {
+    iterations *= 2;
+  }
+
+  vector<double> nsPerOp;
+  for (int batch = 0; batch < 5; batch++) {
+    nsPerOp.push_back(timeBatch(iterations) * 1e9 / iterations);
+  }
+  sort(nsPerOp.begin(), nsPerOp.end());
+  double ns = nsPerOp[nsPerOp.size() / 2];
+
+  printf("{\"name\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.1f",
+         benchmark.name.c_str(), iterations, ns);
+  if (benchmark.bytes > 0) {
+    printf(", \"bytes_per_second\": %.4g", benchmark.bytes * 1e9 / ns);
+  }
+  if (benchmark.swaps > 0) {
+    printf(", \"swaps_per_second\": %.4g", benchmark.swaps * 1e9 / ns);
+  }
+  if (benchmark.messages > 0) {
+    printf(", \"messages_per_second\": %.4g",
+           benchmark.messages * 1e9 / ns);
+  }
+  printf("}\n");
+  fflush(stdout);
+}
+
+// Swaps one solve proposes, read from the solver stats of a single run
+size_t solverSwaps(const function<void()>& solve) {
+  solve();
+  return solverStats().totals.swapsProposed;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  string filter;
+  double minTime = 0.5;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.rfind("--filter=", 0) == 0) {
+      filter = arg.substr(9);
+    } else if (arg.rfind("--min-time=", 0) == 0) {
+      minTime = stod(arg.substr(11));
+    } else {
+      cerr << "Usage: ciphers_bench [--filter=SUBSTRING] [--min-time=SECONDS]"
+           << endl;
+      return 1;
+    }
+  }
+
+  const string cryptogram = readFile("cryptogram.txt");
+  const string plaintext = readFile("plaintext.txt");
+  const string fireIce = readFile("test_data/fire_ice_enc.txt");
+  if (cryptogram.empty() || plaintext.empty() || fireIce.empty()) {
+    cerr << "Run ciphers_bench from the repository root" << endl;
+    return 1;
+  }
+
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  const vector<char> cipher = genRandomSubstCipher();
+  const string cleanPlaintext = clean(plaintext);
+
+  // One swap per call, cycling through all 325 letter pairs
+  vector<uint8_t> cryptogramLetters = cleanToIndices(cryptogram);
+  QuadgramTerms terms(cryptogramLetters);
+  IncrementalScorer incremental(scorer, terms, frequencyKey(cryptogramLetters));
+  int letter1 = 0;
+  int letter2 = 1;
+
+  auto decryptFireIce = [&] {
+    Random::seed(1);
+    keep(decryptSubstCipher(scorer, fireIce));
+  };
+  auto decryptCryptogram = [&] {
+    Random::seed(1);
+    keep(decryptSubstCipher(scorer, cryptogram));
+  };
+
+  // Log-line sized messages: 64 slices of 40 to 190 letters, each with its
+  // own key
+  vector<string> shortMessages;
+  for (size_t i = 0; i < 64; i++) {
+    shortMessages.push_back(applySubstCipher(
+        genRandomSubstCipher(),
+        cleanPlaintext.substr(i * 50, 40 + (i * 37) % 151)));
+  }
+
+  vector<Benchmark> benchmarks = {
+      {"rot", cryptogram.size(), 0, [&] { keep(rot(cryptogram, 3)); }},
+      {"clean", cryptogram.size(), 0, [&] { keep(clean(cryptogram)); }},
+      {"applySubstCipher", cryptogram.size(), 0,
+       [&] { keep(applySubstCipher(cipher, cryptogram)); }},
+      {"scoreString", cleanPlaintext.size(), 0,
+       [&] { keep(scoreString(scorer, cleanPlaintext)); }},
+      {"QuadgramScorer/csv", 0, 0,
+       [&] {
+         QuadgramScorer csv("missing_quadgrams.bin", "english_quadgrams.txt");
+         keep(csv);
+       }},
+      {"Dictionary::load", 0, 0,
+       [&] { keep(Dictionary::load("dictionary.txt")); }},
+      {"IncrementalScorer::trySwap", 0, 1,
+       [&] {
+         keep(incremental.trySwap(letter1, letter2));
+         incremental.rollback();
+         if (++letter2 == 26) {
+           letter1 = (letter1 + 1) % 25;
+           letter2 = letter1 + 1;
+         }
+       }},
+      {"decryptSubstCipher/fire_ice", fireIce.size(),
+       solverSwaps(decryptFireIce), decryptFireIce},
+      {"decryptSubstCipher/cryptogram", cryptogram.size(),
+       solverSwaps(decryptCryptogram), decryptCryptogram},
+      {"decryptSubstCipher/short_messages", 0, 0,
+       [&] {
+         Random::seed(1);
+         for (const string& message : shortMessages) {
+           keep(decryptSubstCipher(scorer, message));
+         }
+       },
+       shortMessages.size()},
+      {"decryptSubstCiphers/short_messages", 0, 0,
+       [&] {
+         Random::seed(1);
+         keep(decryptSubstCiphers(scorer, shortMessages));
+       },
+       shortMessages.size()},
+  };
+
+  // Only meaningful once `make quadgrams` has built the table
+  if (scorer.isMapped()) {
+    benchmarks.push_back({"QuadgramScorer/binary", 0, 0, [&] {
+                            QuadgramScorer binary("english_quadgrams.bin",
+                                                  "english_quadgrams.txt");
+                            keep(binary);
+                          }});
+  }
+
+  for (const Benchmark& benchmark : benchmarks) {
+    if (benchmark.name.find(filter) != string::npos) {
+      measure(benchmark, minTime);
+    }
+  }
+  return 0;
+}
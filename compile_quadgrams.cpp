@@ -0,0 +1,35 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+using namespace std;
+
+// Converts the quadgram counts CSV into the precompiled table that
+// QuadgramScorer maps at startup, so the CSV doesn't have to be parsed (and
+// the logarithms recomputed) on every run.
+//
+// Usage: compile_quadgrams [input.csv] [output.bin]
+
+int main(int argc, char* argv[]) {
+  string csvPath = argc > 1 ? argv[1] : "english_quadgrams.txt";
+  string binaryPath = argc > 2 ? argv[2] : "english_quadgrams.bin";
+
+  vector<string> quadgrams;
+  vector<int> counts;
+  QuadgramScorer::readCsv(csvPath, quadgrams, counts);
+  if (quadgrams.empty()) {
+    cerr << "No quadgrams found in " << csvPath << endl;
+    return 1;
+  }
+
+  QuadgramScorer scorer(quadgrams, counts);
+  if (!scorer.save(binaryPath)) {
+    cerr << "Couldn't write " << binaryPath << endl;
+    return 1;
+  }
+  cout << "Wrote " << quadgrams.size() << " quadgrams to " << binaryPath
+       << endl;
+  return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "include/kernels.h"
+#include "include/subst_dec.h"
+#include "include/subst_enc.h"
+#include "utils.h"
+
+using namespace std;
+
+// ========== Batch Decryption ==========
+
+/**
+ * Expands every pattern containing `*`, `?` or `[` into the files it
+ * matches, in sorted order, and keeps other arguments as they are. A pattern
+ * that matches nothing is kept too, so it's reported as a failure rather than
+ * silently skipped.
+ */
+vector<string> expandInputs(const vector<string>& patterns);
+
+/**
+ * How decrypting one file of a batch went.
+ */
+struct BatchResult {
+  string input;
+  string output;
+  bool ok = false;
+  string error;  // Why it failed, if it did
+  size_t letters = 0;
+  double seconds = 0;
+  SubstKey key = {};
+};
+
+/**
+ * Totals over a whole batch.
+ */
+struct BatchSummary {
+  size_t files = 0;
+  size_t failed = 0;
+  size_t letters = 0;
+  size_t bytes = 0;
+  double seconds = 0;
+};
+
+/**
+ * Solves every file in `inputs` for its substitution key, and writes it
+ * decrypted into `outputDir` under its own file name, keeping its layout like
+ * the `F` command does. `outputDir` is created if it doesn't exist.
+ *
+ * The files are solved on a `WorkStealingPool` of `options.threads` workers,
+ * biggest first, and each file's restarts spread over whichever workers are
+ * idle. `onResult` is called as each file finishes, one call at a time, in
+ * the order they finish.
+ *
+ * Each file gets its own seed, drawn from `Random` in input order, so the
+ * keys don't depend on the thread count or on which files finish first.
+ *
+ * Files that would write the same output, because their names match, fail
+ * after the first one in `inputs`, and so does a file whose output would be
+ * the file itself. The summary only counts the letters and
+ * bytes of files that succeeded.
+ */
+BatchSummary batchDecryptFiles(
+    const QuadgramScorer& scorer, const vector<string>& inputs,
+    const string& outputDir, const SolverOptions& options,
+    const function<void(const BatchResult&)>& onResult);
+
+/**
+ * One line of JSON per result and for the summary, for example:
+ *
+ *   {"input": "a.txt", "output": "out/a.txt", "ok": true, "letters": 4512,
+ *    "seconds": 0.21, "key": "QSZJ..."}
+ *   {"files": 3, "failed": 1, "letters": 9730, "seconds": 0.42,
+ *    "files_per_second": 7.1, "letters_per_second": 23166}
+ */
+string batchResultJson(const BatchResult& result);
+string batchSummaryJson(const BatchSummary& summary);
+
+/**
+ * Solves each of `messages` (letter indices, see `cleanToIndices`) for its
+ * own substitution key. Made for thousands of short messages, such as log
+ * lines, where the work per message is too small to pay for `solveSubstKey`
+ * calls one by one.
+ *
+ * Messages are sorted by length and hill-climbed `SCORE_LANES` at a time,
+ * one per lane of `scoreSwapLanes`, so the quadgram lookups for the lanes'
+ * swaps are done together. A lane that finishes its message's restarts
+ * takes the next message. Each lane rescores its whole text on every swap,
+ * which is the right trade for short texts only; give long ones to
+ * `solveSubstKey`.
+ *
+ * Each call takes one seed from the shared `Random` generator, and restart
+ * `r` of message `i` draws from the `options.rng` stream for (seed, `i`,
+ * `r`), so the keys don't depend on `options.threads` or on the other
+ * messages. Each message gets its own `timeLimit`, counted from when a lane
+ * takes it, and its own `swapLimit`, and stops early as `solveSubstKey`
+ * would. Hill climbing always uses the full-precision table. Also honors
+ * `options.restarts`, `warmStart`, `perturbSwaps`, `agreeRestarts` and
+ * `threads`. With any engine but hill climbing, each message's restarts run
+ * one by one with `solveSubstRestart` instead, as job `i`.
+ */
+vector<SubstKey> solveSubstKeys(const QuadgramScorer& scorer,
+                                const vector<vector<uint8_t>>& messages,
+                                const SolverOptions& options = SolverOptions());
+
+/**
+ * Same as `solveSubstKeys`, for raw ciphertexts. Returns each key as
+ * `decryptSubstCipher` does.
+ */
+vector<vector<char>> decryptSubstCiphers(
+    const QuadgramScorer& scorer, const vector<string>& ciphertexts,
+    const SolverOptions& options = SolverOptions());
+
+/**
+ * Runs the batch decryption routine. Prompts from the console input (cin) for
+ * input files (a space-separated list, globs allowed) and an output
+ * directory, then prints each file's result and the summary as they come.
+ */
+void batchDecryptCommand(const QuadgramScorer& scorer,
+                         const SolverOptions& options = SolverOptions());
+
+/**
+ * Decrypts `inputs` (globs allowed) into `outputDir`, printing each result
+ * and then the summary to the console (cout) as JSON lines. Returns main's
+ * exit code: 0 if every file was decrypted.
+ */
+int batchCommand(const QuadgramScorer& scorer, const vector<string>& inputs,
+                 const string& outputDir, const SolverOptions& options);
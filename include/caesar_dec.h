@@ -1,6 +1,9 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace std;
@@ -29,6 +32,15 @@ void rot(vector<string>& strings, int amount);
  */
 string clean(const string& s);
 
+/**
+ * Same as `clean`, but returns each letter as its index in the alphabet
+ * (0 to 25) instead of as a character.
+ *
+ * For example:
+ *  `cleanToIndices("a-b c")` returns `{0, 1, 2}`
+ */
+vector<uint8_t> cleanToIndices(const string& s);
+
 /**
  * Given a string `s`, returns a vector where each item is a single word from
  * `s`. There may be multiple spaces between words, spaces at the beginning,
@@ -48,6 +60,42 @@ vector<string> splitBySpaces(const string& s);
  */
 string joinWithSpaces(const vector<string>& words);
 
+/**
+ * A read-only set of dictionary words, built once for fast lookups. Every
+ * word is stored back to back in one buffer, and an open-addressing hash
+ * table of word numbers indexes it, so a lookup hashes the word once and
+ * usually compares against a single candidate.
+ */
+class Dictionary {
+ private:
+  struct Slot {
+    uint32_t word;  // Word number + 1, or 0 if the slot is empty
+    uint32_t hash;  // Low bits of the word's hash, to skip most compares
+  };
+
+  string arena;
+  vector<uint32_t> offsets;  // Start of each word in `arena`, plus the end
+  vector<Slot> slots;
+  size_t mask;
+
+  static uint64_t hash(string_view word);
+  string_view wordAt(uint32_t i) const;
+
+ public:
+  explicit Dictionary(const vector<string>& words);
+
+  /**
+   * Reads one word per line from the file at `path`.
+   */
+  static Dictionary load(const string& path);
+
+  bool contains(string_view word) const;
+
+  size_t size() const {
+    return offsets.size() - 1;
+  }
+};
+
 /**
  * Returns the number of strings in `words` that are also in `dict`.
  *
@@ -60,6 +108,35 @@ string joinWithSpaces(const vector<string>& words);
  */
 int numWordsIn(const vector<string>& words, const vector<string>& dict);
 
+/**
+ * Same as above, but looks words up in a prebuilt `Dictionary`. The
+ * `string_view` overload lets callers count words without copying them.
+ */
+int numWordsIn(const vector<string>& words, const Dictionary& dict);
+int numWordsIn(const vector<string_view>& words, const Dictionary& dict);
+
+/**
+ * Ranks all 26 rotations of `letters` (letter indices, see `cleanToIndices`)
+ * from most to least English-looking. Only the text's 26-bin letter
+ * histogram is used: rotation `r` is scored by the chi-squared distance
+ * between the histogram rotated by `r` and English letter frequencies.
+ */
+array<int, 26> rankCaesarShifts(const vector<uint8_t>& letters);
+
+/**
+ * Returns, in increasing order, every rotation of `cleanedWords` for which
+ * more than half of the rotated words are in `dict`.
+ *
+ * Texts of at least `CAESAR_RANKED_MIN_LETTERS` letters only have their
+ * `CAESAR_RANKED_CANDIDATES` best-ranked rotations checked against the
+ * dictionary (see `rankCaesarShifts`). Shorter texts, where a histogram says
+ * little, have all 26 checked.
+ */
+const size_t CAESAR_RANKED_MIN_LETTERS = 64;
+const int CAESAR_RANKED_CANDIDATES = 3;
+vector<int> findCaesarShifts(const vector<string>& cleanedWords,
+                             const Dictionary& dict);
+
 /**
  * Runs the Caesar decryption routine. Prompts from the console input
  * (cin) once to get the text to decrypt. For each decryption with more than
@@ -69,3 +146,8 @@ int numWordsIn(const vector<string>& words, const vector<string>& dict);
  * part: `rot`, `clean`, `splitBySpaces`, `join`, and `numWordsIn`.
  */
 void caesarDecryptCommand(const vector<string>& dict);
+
+/**
+ * Same as above, with a prebuilt `Dictionary`.
+ */
+void caesarDecryptCommand(const Dictionary& dict);
@@ -41,3 +41,23 @@ string rot(const string& line, int amount);
  * rotate by. Prints the result of the caesar shift to the console (cout).
  */
 void caesarEncryptCommand();
+
+/**
+ * Rotates every letter in the file at `inputPath` by `amount` and writes the
+ * result to `outputPath`. The file is processed a chunk at a time, so memory
+ * use doesn't depend on its size. Letters are uppercased, but unlike `rot`,
+ * every other byte is kept as-is so line breaks and punctuation survive. Use
+ * a negative `amount` to decrypt.
+ *
+ * The output is written to a new file and renamed into place at the end, so
+ * it may be the input itself. Returns false, leaving the output as it was, if
+ * either file couldn't be opened, read or written.
+ */
+bool rotFile(const string& inputPath, const string& outputPath, int amount);
+
+/**
+ * Runs the Caesar file routine. Prompts from the console input (cin) for the
+ * input file name, the output file name, and the number to rotate by, then
+ * calls `rotFile`.
+ */
+void caesarFileCommand();
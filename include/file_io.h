@@ -0,0 +1,69 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// ========== File I/O ==========
+
+/**
+ * Bytes read or written at a time by the streaming file commands, so their
+ * memory use doesn't grow with the file.
+ */
+const size_t FILE_CHUNK_SIZE = 1 << 20;
+
+/**
+ * Reads the file at `path` in chunks of up to `chunkSize` bytes and calls
+ * `f(data, n)` on each. `f` may modify the chunk, and returns false to stop
+ * early. Returns false if the file couldn't be read or `f` stopped early.
+ */
+template <class F>
+bool forEachFileChunk(const string& path, size_t chunkSize, F f) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  vector<char> chunk(chunkSize);
+  bool ok = true;
+  while (ok) {
+    ssize_t got = read(fd, chunk.data(), chunk.size());
+    if (got == 0) {
+      break;
+    } else if (got < 0) {
+      ok = errno == EINTR;
+    } else {
+      ok = f(chunk.data(), (size_t)got);
+    }
+  }
+
+  close(fd);
+  return ok;
+}
+
+/**
+ * Writes all `n` bytes at `data` to `fd`, retrying short writes. Returns
+ * false on error.
+ */
+bool writeAll(int fd, const char* data, size_t n);
+
+/**
+ * Calls `write(fd)` to fill a new file next to `path`, then renames it over
+ * `path` if `write` returned true. `path` is untouched until then, so `write`
+ * may read from it. Returns false, leaving no new file behind, if any step
+ * failed.
+ */
+bool replaceFile(const string& path, const function<bool(int)>& write);
+
+/**
+ * Whether `a` and `b` both exist and are the same file, however they're
+ * spelled: same device and inode.
+ */
+bool sameFile(const string& a, const string& b);
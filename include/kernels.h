@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// ========== Byte Kernels ==========
+
+/**
+ * Instruction sets the byte kernels below can use. Every kernel has a scalar
+ * version, so any level works on any machine; levels the CPU doesn't support
+ * fall back to the best one it does. `AVX512` means AVX-512 BW and VBMI2.
+ */
+enum class SimdLevel { Scalar, SSE41, AVX2, AVX512 };
+
+/**
+ * Returns the best level this CPU supports. Checked once, then cached.
+ * Always `Scalar` on non-x86 builds.
+ */
+SimdLevel bestSimdLevel();
+
+/**
+ * Copies the `n` bytes at `in` to `out`, replacing every ASCII letter (either
+ * case) with `table[i]`, where `i` is the letter's index in the alphabet.
+ * All other bytes are copied unchanged. `in` and `out` may be the same
+ * buffer.
+ *
+ * For example, with `table` = "BCD...ZA":
+ * - "Hello, World!" becomes "IFMMP, XPSME!"
+ */
+void translateLetters(const char table[26], const char* in, char* out,
+                      size_t n, SimdLevel level = bestSimdLevel());
+
+/**
+ * Like `translateLetters`, but every whitespace byte is written as ' ' and
+ * every other non-letter is dropped. Returns the number of bytes written to
+ * `out`, which needs room for `n`. This is `rot(string, int)` when `table`
+ * is a rotated alphabet.
+ *
+ * For example, with `table` = "BCD...ZA":
+ * - "drag on!\n" becomes "ESBH PO "
+ */
+size_t translateWords(const char table[26], const char* in, char* out,
+                      size_t n, SimdLevel level = bestSimdLevel());
+
+/**
+ * Writes only the ASCII letters among the `n` bytes at `in` to `out`, and
+ * returns how many were written. Each letter is written as `base` plus its
+ * index in the alphabet, so `base` = 'A' gives uppercase text and `base` = 0
+ * gives letter indices. `out` needs room for `n`, and may be `in`.
+ *
+ * For example:
+ * - "a-b c" becomes "ABC" with `base` = 'A', or {0, 1, 2} with `base` = 0
+ */
+size_t compactLetters(const char* in, char* out, size_t n, char base,
+                      SimdLevel level = bestSimdLevel());
+
+// ========== Lane Kernels ==========
+
+/**
+ * Number of texts `scoreSwapLanes` scores at once.
+ */
+const size_t SCORE_LANES = 8;
+
+/**
+ * Scores `SCORE_LANES` texts at once, each decrypted under its own key with
+ * two of its key entries swapped. Each solver lane holds one short message,
+ * and the quadgram lookups for every lane are done together.
+ *
+ * The texts are interleaved: letter `p` of lane `lane` is at
+ * `p * SCORE_LANES + lane`, for `length` letters per lane. `cipher` holds
+ * cipher letter indices, and `plain` their decryptions under the current
+ * keys. Each lane's trial decryption flips the cipher letters
+ * `letter1[lane]` and `letter2[lane]` between their two plaintext letters,
+ * by XORing them with `flip[lane]` (the XOR of the two). It's written to
+ * `trial`, and `scores[lane]` is set to the sum of `table` (26^4 log
+ * likelihoods, see `QuadgramScorer::table`) over the quadgrams in its first
+ * `lengths[lane]` letters, in order.
+ *
+ * Every quadgram is looked up, not just the ones the swap changed: a row of
+ * lanes costs one gather either way, and gathering only the changed ones
+ * needs the old values too. Cipher letters outside 0-25 are padding and
+ * never flip. Every level gives exactly the same scores.
+ */
+void scoreSwapLanes(const double* table, const int32_t* cipher,
+                    const int32_t* plain, int32_t* trial, size_t length,
+                    const int32_t lengths[], const int32_t letter1[],
+                    const int32_t letter2[], const int32_t flip[],
+                    double scores[], SimdLevel level = bestSimdLevel());
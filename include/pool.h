@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// ========== Thread Pool ==========
+
+/**
+ * A fixed set of worker threads, each with its own queue of tasks. A worker
+ * runs its own tasks oldest first; once they run out, it steals the newest
+ * task from another worker's queue. Big and small tasks can be mixed freely:
+ * nobody sits idle while any queue still has work.
+ *
+ * `parallelFor` called from one of the workers runs on the pool too, so a
+ * task can split itself up without starting threads of its own.
+ */
+class WorkStealingPool {
+ private:
+  struct Queue {
+    mutex lock;
+    deque<function<void()>> tasks;
+  };
+
+  vector<unique_ptr<Queue>> queues;
+  vector<thread> threads;
+
+  // Tasks submitted but not finished, and whether the destructor has run
+  mutex stateLock;
+  condition_variable workAvailable;
+  condition_variable allDone;
+  size_t unfinished = 0;
+  size_t queued = 0;
+  bool stopping = false;
+
+  atomic<size_t> nextQueue{0};
+
+  // The pool and queue of the worker running the calling thread
+  static WorkStealingPool*& currentPool();
+  static size_t& currentIndex();
+
+  // Takes a task from queue `index`, or steals one from another queue
+  bool take(size_t index, function<void()>& task);
+  void work(size_t index);
+
+ public:
+  explicit WorkStealingPool(int threads);
+
+  // Finishes every submitted task first
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  size_t size() const {
+    return threads.size();
+  }
+
+  /**
+   * Queues `task`. From a worker it goes on that worker's own queue, and
+   * otherwise the queues take turns.
+   */
+  void submit(function<void()> task);
+
+  /**
+   * Blocks until every task submitted so far has finished. Not for use from
+   * the pool's own workers.
+   */
+  void wait();
+
+  /**
+   * Calls `f(i)` for every `i` from 0 to `n - 1` on the calling thread and
+   * any idle workers, at most `threads` threads in all, and returns once all
+   * calls have finished. The calling thread only ever runs `f`, so
+   * thread-local state it set up before the call is still its own
+   * afterwards.
+   */
+  template <class F>
+  void parallelFor(size_t n, F f, size_t threads = SIZE_MAX) {
+    struct Group {
+      atomic<size_t> next{0};
+      size_t finished = 0;
+      mutex lock;
+      condition_variable done;
+    };
+    auto group = make_shared<Group>();
+
+    // Helpers that start late find nothing left to claim, and never touch
+    // `f` after the caller has returned
+    auto claim = [group, n, &f] {
+      for (size_t i = group->next++; i < n; i = group->next++) {
+        f(i);
+        lock_guard<mutex> lock(group->lock);
+        if (++group->finished == n) {
+          group->done.notify_all();
+        }
+      }
+    };
+    for (size_t i = 1; i < min({n, size(), threads}); i++) {
+      submit(claim);
+    }
+    claim();
+
+    unique_lock<mutex> lock(group->lock);
+    group->done.wait(lock, [&] { return group->finished == n; });
+  }
+
+  /**
+   * The pool whose worker is running the calling thread, if any.
+   */
+  static WorkStealingPool* current() {
+    return currentPool();
+  }
+};
+
+/**
+ * The process-wide pool, with a worker per hardware thread. It's started by
+ * the first call, and lives until the program exits.
+ */
+WorkStealingPool& sharedPool();
+
+/**
+ * Calls `f(i)` for every `i` from 0 to `n - 1`, spread over up to `threads`
+ * threads (including the calling one). Each thread repeatedly claims the
+ * next unclaimed `i`, so uneven amounts of work still balance out.
+ *
+ * The other threads are `sharedPool`'s workers, so no threads are started
+ * per call. Called from a `WorkStealingPool` worker, it ignores `threads`
+ * and uses that pool's idle workers instead.
+ */
+template <class F>
+void parallelFor(size_t n, int threads, F f) {
+  if (WorkStealingPool* pool = WorkStealingPool::current()) {
+    pool->parallelFor(n, f);
+    return;
+  }
+
+  if (threads <= 1 || n <= 1) {
+    for (size_t i = 0; i < n; i++) {
+      f(i);
+    }
+    return;
+  }
+  sharedPool().parallelFor(n, f, threads);
+}
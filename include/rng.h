@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+using namespace std;
+
+// ========== Random Number Engines ==========
+
+// Defined here in full, so their draws inline into the solver's loops
+
+/**
+ * xoshiro256** (https://prng.di.unimi.it/xoshiro256starstar.c), a small, fast
+ * generator for the solver's inner loops. Its 32 bytes of state sit next to
+ * the solver instead of in a 2.5 KB mt19937. It returns the high 32 bits of
+ * each output, so it can stand in for mt19937 anywhere.
+ */
+class Xoshiro256 {
+ private:
+  uint64_t state[4];
+
+  static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+ public:
+  using result_type = uint32_t;
+
+  /**
+   * Expands `seed` into the full state with splitmix64, as the authors
+   * recommend, so nearby seeds still give unrelated streams.
+   */
+  explicit Xoshiro256(uint64_t seed) {
+    for (uint64_t& word : state) {
+      seed += 0x9E3779B97F4A7C15ull;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      word = z ^ (z >> 31);
+    }
+  }
+
+  static constexpr result_type min() {
+    return 0;
+  }
+
+  static constexpr result_type max() {
+    return UINT32_MAX;
+  }
+
+  result_type operator()() {
+    uint64_t result = rotl(state[1] * 5, 7) * 9;
+    uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+    return result >> 32;
+  }
+};
+
+/**
+ * Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2,
+ * 3"), a counter-based generator. Output block `n` of stream (`seed`, `job`,
+ * `stream`) is a keyed hash of `n`, so every stream is independent of every
+ * other, and nothing about one depends on how many values were drawn from
+ * another, or in what order.
+ */
+class Philox {
+ private:
+  static const uint32_t MULTIPLIER0 = 0xD2511F53;
+  static const uint32_t MULTIPLIER1 = 0xCD9E8D57;
+  static const uint32_t KEY_BUMP0 = 0x9E3779B9;
+  static const uint32_t KEY_BUMP1 = 0xBB67AE85;
+
+  array<uint32_t, 2> key;
+  array<uint32_t, 4> counter;
+  array<uint32_t, 4> block;
+  int used = 4;
+
+ public:
+  using result_type = uint32_t;
+
+  Philox(uint32_t seed, uint32_t job, uint32_t stream)
+      : key{seed, job}, counter{0, 0, stream, 0} {}
+
+  /**
+   * The ten Philox rounds: hashes `counter` under `key` into four words.
+   */
+  static array<uint32_t, 4> generate(array<uint32_t, 4> counter,
+                                     array<uint32_t, 2> key) {
+    for (int round = 0; round < 10; round++) {
+      uint64_t product0 = (uint64_t)MULTIPLIER0 * counter[0];
+      uint64_t product1 = (uint64_t)MULTIPLIER1 * counter[2];
+      counter = {(uint32_t)(product1 >> 32) ^ counter[1] ^ key[0],
+                 (uint32_t)product1,
+                 (uint32_t)(product0 >> 32) ^ counter[3] ^ key[1],
+                 (uint32_t)product0};
+      key[0] += KEY_BUMP0;
+      key[1] += KEY_BUMP1;
+    }
+    return counter;
+  }
+
+  static constexpr result_type min() {
+    return 0;
+  }
+
+  static constexpr result_type max() {
+    return UINT32_MAX;
+  }
+
+  result_type operator()() {
+    if (used == 4) {
+      block = generate(counter, key);
+      used = 0;
+      // The first two words count blocks, as one 64-bit number
+      if (++counter[0] == 0) {
+        counter[1]++;
+      }
+    }
+    return block[used++];
+  }
+};
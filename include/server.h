@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "include/caesar_dec.h"
+#include "include/subst_dec.h"
+#include "utils.h"
+
+using namespace std;
+
+// ========== Server ==========
+
+/**
+ * A value from a flat JSON object: the unescaped contents of a string, or the
+ * literal text of a number, `true`, `false` or `null`.
+ */
+struct JsonValue {
+  string text;
+  bool isString = false;
+};
+
+/**
+ * Parses one JSON object whose values are all strings, numbers, booleans or
+ * null. Nested objects and arrays aren't needed by any request, so they're
+ * rejected, as are bare values that aren't numbers or literals. Throws
+ * `invalid_argument` with the reason if `line` isn't such an object.
+ *
+ * For example:
+ * - {"op": "score", "text": "HELLO"} gives op = "score" and text = "HELLO"
+ */
+map<string, JsonValue> parseJsonObject(const string& line);
+
+/**
+ * Returns `s` as a quoted JSON string, escaping quotes, backslashes and
+ * control characters.
+ */
+string jsonString(const string& s);
+
+/**
+ * Most restarts a subst_decrypt request may ask for. The restarts' results
+ * are all held at once, so this bounds what one request can allocate.
+ */
+const int SERVER_MAX_RESTARTS = 1000;
+
+/**
+ * Runs one request and returns its result as JSON members, without the
+ * surrounding braces, for example `"score": -3.79107`. Throws
+ * `invalid_argument` for unknown ops or missing or bad fields.
+ *
+ * Ops and their fields:
+ * - score: text
+ * - caesar_encrypt: text, shift
+ * - caesar_decrypt: text; returns every candidate `caesarDecryptCommand`
+ *   would print
+ * - subst_encrypt: text, and key (26 letters, random if missing)
+ * - subst_decrypt: text, and optionally seed, restarts (at most
+ *   `SERVER_MAX_RESTARTS`), agree and time_limit, which override `options`
+ *   for this request. The seed is used for this solve only.
+ */
+string handleRequest(const map<string, JsonValue>& request,
+                     const Dictionary& dict, const QuadgramScorer& scorer,
+                     const SolverOptions& options);
+
+/**
+ * Requests a server holds before readers have to wait for the workers. A
+ * full queue stops reading from the connection, so clients that send faster
+ * than the server can answer see their writes block.
+ */
+const size_t SERVER_QUEUE_CAPACITY = 1024;
+
+/**
+ * Most small requests a worker takes from the queue at once. Their responses
+ * go out in one write per connection.
+ */
+const size_t SERVER_BATCH_SIZE = 32;
+
+/**
+ * Longest request line a server reads, in bytes, newline excluded. A longer
+ * line is answered with an error instead of being buffered.
+ */
+const size_t SERVER_MAX_LINE_BYTES = 64 << 20;
+
+/**
+ * Answers newline-delimited JSON requests with the dictionary and scorer
+ * loaded once. Every request is an object with an "op" (see
+ * `handleRequest`) and an optional "id", which is echoed back. Every
+ * response is one line:
+ *
+ *   {"id": 7, "ok": true, "latency_us": 12, "score": -3.79107}
+ *   {"id": 8, "ok": false, "latency_us": 3, "error": "Unknown op: foo"}
+ *
+ * `latency_us` runs from reading the request to sending its response.
+ * Responses can come back in a different order from the requests, so
+ * clients that pipeline should set "id". The "metrics" op returns request
+ * counts and latency percentiles per op.
+ *
+ * `options.threads` workers run the requests, and each solve runs its
+ * restarts on the worker's own thread.
+ * SIGPIPE is ignored from the moment a server is made, so writing to a client
+ * that hung up fails instead of ending the process.
+ */
+class Server {
+ private:
+  struct Connection;
+  struct Request;
+
+  // Power-of-two buckets of microseconds, enough for over an hour
+  static const int LATENCY_BUCKETS = 33;
+
+  struct OpMetrics {
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t maxMicros = 0;
+    array<uint64_t, LATENCY_BUCKETS> buckets = {};
+  };
+
+  const Dictionary& dict;
+  const QuadgramScorer& scorer;
+  SolverOptions options;
+
+  mutex queueLock;
+  condition_variable queueNotEmpty;
+  condition_variable queueNotFull;
+  deque<Request> queue;
+  bool stopping = false;
+  uint64_t queueFullWaits = 0;
+
+  mutex metricsLock;
+  map<string, OpMetrics> metrics;
+
+  vector<thread> workers;
+
+  void enqueue(Request request);
+  void work();
+  void respond(vector<Request>& batch);
+  void record(const string& op, bool ok, uint64_t micros);
+
+ public:
+  Server(const Dictionary& dict, const QuadgramScorer& scorer,
+         const SolverOptions& options);
+
+  // Finishes the queued requests, then stops the workers
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  /**
+   * Reads requests from `inFd` and writes responses to `outFd` until `inFd`
+   * ends, then waits for the last responses before returning.
+   */
+  void serveStream(int inFd, int outFd);
+
+  /**
+   * Listens on a Unix domain socket at `path`, replacing any file there, and
+   * serves every connection with `serveStream` on its own reader thread.
+   * Only returns, with false, if the socket can't be set up.
+   */
+  bool serveSocket(const string& path);
+
+  /**
+   * Request counts, errors and latency percentiles for each op so far, as
+   * JSON members.
+   */
+  string metricsJson();
+};
+
+/**
+ * Serves requests on stdin and stdout, or on the Unix socket at `path` if
+ * it's set. Returns main's exit code.
+ */
+int serveCommand(const Dictionary& dict, const QuadgramScorer& scorer,
+                 const SolverOptions& options, const string& path = "");
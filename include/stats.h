@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// ========== Solver Statistics ==========
+
+// Counting is on unless built with -DCIPHERS_NO_STATS, which compiles every
+// counter update and phase timer away
+#ifdef CIPHERS_NO_STATS
+#define CIPHERS_STAT(statement)
+#else
+#define CIPHERS_STAT(statement) statement
+#endif
+
+/**
+ * Work done by one solver restart. Each restart counts on its own, so
+ * threads never share a counter.
+ */
+struct RestartCounters {
+  // Counted even with CIPHERS_NO_STATS, since the swap budget needs it
+  uint64_t swapsProposed = 0;
+  uint64_t swapsAccepted = 0;
+  // Quadgram table lookups: one per term rescored (see `QuadgramTerms`)
+  uint64_t quadgramsScored = 0;
+  // Swaps looked up in the solve's `ScoreCache`, and those turned down on
+  // the cached score alone
+  uint64_t cacheLookups = 0;
+  uint64_t cacheHits = 0;
+};
+
+/**
+ * What the most recent decryption on this thread did, and how long each
+ * phase took. Solves add to it until `reset` is called, which the decryption
+ * commands do before they start.
+ */
+struct SolverStats {
+  RestartCounters totals;
+  uint64_t restarts = 0;
+  // Final score of each restart, in restart order
+  vector<double> restartScores;
+
+  // Seconds spent loading the dictionary and quadgram table at startup, and
+  // in each phase of the last decryption
+  double loadSeconds = 0;
+  double cleanSeconds = 0;
+  double climbSeconds = 0;
+  double applySeconds = 0;
+
+  /**
+   * Clears everything but `loadSeconds`, which only happens once.
+   */
+  void reset();
+
+  /**
+   * Adds one restart's counters and score.
+   */
+  void addRestart(const RestartCounters& counters, double score);
+
+  /**
+   * The stats as a single line of JSON, for example:
+   *
+   *   {"restarts": 2, "swaps_proposed": 5120, "swaps_accepted": 130,
+   *    "quadgrams_scored": 912345, "cache_lookups": 0, "cache_hits": 0,
+   *    "restart_scores": [-9120.5, -9344.1],
+   *    "seconds": {"load": 0.01, "clean": 0.0001, "climb": 0.52,
+   *    "apply": 0.0002}}
+   */
+  string toJson() const;
+
+  /**
+   * The stats as a few lines of text for the console.
+   */
+  string toText() const;
+};
+
+/**
+ * The stats for this thread.
+ */
+SolverStats& solverStats();
+
+/**
+ * Adds the time from construction to destruction to `seconds`.
+ */
+class PhaseTimer {
+ private:
+#ifndef CIPHERS_NO_STATS
+  double& seconds;
+  chrono::steady_clock::time_point start;
+#endif
+
+ public:
+#ifdef CIPHERS_NO_STATS
+  explicit PhaseTimer(double&) {}
+#else
+  explicit PhaseTimer(double& seconds)
+      : seconds(seconds), start(chrono::steady_clock::now()) {}
+
+  ~PhaseTimer() {
+    seconds +=
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+#endif
+};
+
+/**
+ * Prints `solverStats()` to the console (cout).
+ */
+void printSolverStatsCommand();
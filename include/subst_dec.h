@@ -1,8 +1,15 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include "include/stats.h"
+#include "include/subst_enc.h"
 #include "utils.h"
 
 using namespace std;
@@ -18,6 +25,12 @@ using namespace std;
  */
 double scoreString(const QuadgramScorer& scorer, const string& s);
 
+/**
+ * Same as `scoreString`, but for text given as letter indices (0 to 25).
+ * Returns 0 for text shorter than 4 letters.
+ */
+double scoreIndices(const QuadgramScorer& scorer, const vector<uint8_t>& text);
+
 /**
  * Runs the command to score the "Englishness" of input text. Prompts from the
  * console input (cin) once to get text. Outputs the Englishness score as
@@ -27,6 +40,124 @@ void computeEnglishnessCommand(const QuadgramScorer& scorer);
 
 // ========== Substitution Cipher Decoder ==========
 
+/**
+ * Search strategies for a single restart of the substitution cipher solver.
+ *
+ * - HillClimb: keep only improving swaps, stop after 1000 failures in a row.
+ * - Anneal: simulated annealing, which also keeps worsening swaps with a
+ *   probability that shrinks as the temperature cools, for a fixed number of
+ *   swaps. Returns the best key seen.
+ * - BestSwap: try every swap of two letters that changes the text, keep the
+ *   one that improves the score most, and repeat until none improves it.
+ * - FirstSwap: like BestSwap, but keep the first improving swap, and carry
+ *   on from the swap after it.
+ *
+ * The sweeps only draw their starting key at random, and they stop at a key
+ * that no single swap improves. Hill climbing can stop short of that if it
+ * misses the few improving swaps 1000 times in a row.
+ */
+enum class SolverEngine { HillClimb, Anneal, BestSwap, FirstSwap };
+
+/**
+ * How the solver lays out the quadgrams it scores (see `QuadgramTerms`).
+ * Auto uses the histogram when the text has at most half as many distinct
+ * quadgrams as quadgram positions.
+ */
+enum class ScoringMode { Auto, Positions, Histogram };
+
+/**
+ * Generator each solver restart draws its swaps from. Philox (see `Philox`)
+ * gives every (seed, job, restart) its own counter-based stream. Xoshiro
+ * (xoshiro256**, see `Xoshiro256`) seeds a small generator from the same
+ * three numbers. Mt19937 reproduces keys found before either was added.
+ */
+enum class RngEngine { Philox, Xoshiro, Mt19937 };
+
+/**
+ * Settings for the substitution cipher solver.
+ */
+struct SolverOptions {
+  SolverEngine engine = SolverEngine::HillClimb;
+
+  // Number of restarts, or 0 for the engine's default (4 for annealing, 25
+  // for the others)
+  int restarts = 0;
+
+  // Annealing schedule. Temperatures are per quadgram of ciphertext, and cool
+  // geometrically from start to end over `annealIterations` swaps.
+  double startTemperature = 0.1;
+  double endTemperature = 0.002;
+  long annealIterations = 10000;
+
+  // Start the first restart from `frequencyKey` instead of a random key, and
+  // every later one from that key with `perturbSwaps` random swaps
+  bool warmStart = false;
+  int perturbSwaps = 4;
+
+  // Number of threads the restarts are spread over. Results don't depend on
+  // this: restart `i` always draws from its own random stream.
+  int threads = 1;
+
+  ScoringMode scoring = ScoringMode::Auto;
+
+  RngEngine rng = RngEngine::Philox;
+
+  // Which job this solve is, for callers that solve many ciphertexts from
+  // one seed; each job's restarts draw from their own streams
+  uint32_t job = 0;
+
+  // Storage for the quadgram table; main applies it to the scorer
+  TableFormat table = TableFormat::Double;
+
+  // For ciphertexts longer than this many letters, solve on a sample of this
+  // length (see `sampleCiphertext`), then hill-climb once on the full text
+  // from the sample's key. 0 always solves on the full text. The sample gets
+  // `SAMPLE_BUDGET_SHARE` of `timeLimit` and `swapLimit`, and the full-text
+  // climb what's left of them.
+  size_t sampleLetters = 0;
+
+  // Budgets for one solve; 0 means no limit. Restarts cut short return the
+  // best key they found so far.
+  // - `timeLimit`: seconds of wall time. Restarts not started by then are
+  //   skipped, so which key wins depends on the machine and its load.
+  // - `swapLimit`: swaps proposed. Restarts count in order from restart 0
+  //   until their swaps add up to the limit, so the result still doesn't
+  //   depend on the thread count. No restart runs past the whole limit, so a
+  //   solve proposes fewer than twice as many swaps.
+  double timeLimit = 0;
+  uint64_t swapLimit = 0;
+
+  // Stop after `agreeRestarts` restarts reach the best score found so far,
+  // counting restarts in order from restart 0, and ignore any later ones.
+  // 0 always runs every restart.
+  int agreeRestarts = 0;
+
+  // Share a `ScoreCache` of 2^`scoreCacheBits` key scores (1 MB by default)
+  // between the hill-climbing restarts of a solve; 0 turns it off. The cache
+  // only saves work, so the key is the same either way.
+  int scoreCacheBits = 16;
+};
+
+/**
+ * Number of evenly spaced stretches `sampleCiphertext` takes its letters
+ * from, so one unusual passage can't skew the sample.
+ */
+const int SAMPLE_SPANS = 8;
+
+/**
+ * Share of a solve's time and swap budgets its sample's restarts get when it
+ * samples. The rest is left for indexing and climbing the full text.
+ */
+const double SAMPLE_BUDGET_SHARE = 0.75;
+
+/**
+ * Returns about `length` letters of `ciphertext`, taken as `SAMPLE_SPANS`
+ * equal stretches spread evenly from its start to its end. Returns the whole
+ * ciphertext if it isn't longer than `length`.
+ */
+vector<uint8_t> sampleCiphertext(const vector<uint8_t>& ciphertext,
+                                 size_t length);
+
 /**
  * Runs the substitution cipher decryption routine. Prompts from the console
  * input (cin) once to get the ciphertext, then runs hill-climbing 25 times to
@@ -34,12 +165,329 @@ void computeEnglishnessCommand(const QuadgramScorer& scorer);
  *
  * Non-letter characters should be preserved.
  */
-void decryptSubstCipherCommand(const QuadgramScorer& scorer);
+void decryptSubstCipherCommand(const QuadgramScorer& scorer,
+                               const SolverOptions& options = SolverOptions());
+
+/**
+ * Runs the file decryption routine. Prompts from the console input (cin) for
+ * an input and an output file name, solves for the key with `solveSubstKey`,
+ * and streams the input file through it into the output file with
+ * `applySubstKeyToFile`. Only the file's letters are held in memory.
+ */
+void decryptSubstFileCommand(const QuadgramScorer& scorer,
+                             const SolverOptions& options = SolverOptions());
 
 /**
  * Decrypts a given substitution cipher text using the hill-climbing algorithm.
  * It tries to find the best decryption key based on the highest English-ness score.
- * 
+ *
+ * Each call takes one seed from the shared `Random` generator, and restart
+ * `i` draws from the stream for (seed, `options.job`, `i`), so the result for
+ * a given seed is the same no matter how many threads run the restarts (see
+ * `solveSubstRestart`).
+ *
  * Returns the best substitution cipher key found.
  */
-vector<char> decryptSubstCipher(const QuadgramScorer& scorer, const string& ciphertext);
+vector<char> decryptSubstCipher(const QuadgramScorer& scorer, const string& ciphertext,
+                                const SolverOptions& options = SolverOptions());
+
+/**
+ * Same as `decryptSubstCipher`, for a ciphertext that has already been
+ * cleaned into letter indices (see `cleanToIndices`).
+ */
+SubstKey solveSubstKey(const QuadgramScorer& scorer,
+                       const vector<uint8_t>& ciphertext,
+                       const SolverOptions& options = SolverOptions());
+
+/**
+ * Returns the key that maps the most common letter of `ciphertext` to E, the
+ * next most common to T, and so on down English letter frequencies.
+ */
+SubstKey frequencyKey(const vector<uint8_t>& ciphertext);
+
+/**
+ * One of `QuadgramScorer`'s tables, as its own type, so the solver picks the
+ * format once per solve instead of on every lookup. Entries are in the
+ * table's own units: log likelihoods for double and float, and for the fixed
+ * point formats integers that sum exactly, where a sum of `n` entries stands
+ * for `n * offset + sum * scale`.
+ */
+template <class T>
+struct QuadgramTable {
+  using Sum = conditional_t<is_integral_v<T>, int64_t, double>;
+
+  const T* values;
+  double scale = 1.0;
+  double offset = 0.0;
+
+  /**
+   * The scorer's table of `T`. Double is always the full-precision table;
+   * throws invalid_argument for the other types unless they're the scorer's
+   * format (see `QuadgramScorer::setFormat`).
+   */
+  explicit QuadgramTable(const QuadgramScorer& scorer);
+
+  Sum operator[](size_t index) const noexcept {
+    return values[index];
+  }
+
+  /**
+   * The log likelihood a sum of `quadgrams` entries stands for.
+   */
+  double toScore(Sum sum, uint64_t quadgrams) const noexcept {
+    return offset * quadgrams + scale * sum;
+  }
+};
+
+template <>
+QuadgramTable<double>::QuadgramTable(const QuadgramScorer& scorer);
+template <>
+QuadgramTable<float>::QuadgramTable(const QuadgramScorer& scorer);
+template <>
+QuadgramTable<int16_t>::QuadgramTable(const QuadgramScorer& scorer);
+template <>
+QuadgramTable<uint8_t>::QuadgramTable(const QuadgramScorer& scorer);
+
+/**
+ * The quadgrams of a cleaned ciphertext that the solver scores keys against,
+ * indexed by the cipher letters they contain.
+ *
+ * Terms are either every quadgram position in order, or, for long texts, each
+ * distinct cipher quadgram once with the number of times it occurs. A key's
+ * score is the sum of count * log likelihood of the decrypted term, so in
+ * histogram form the cost of scoring depends on the text's vocabulary rather
+ * than its length.
+ */
+class QuadgramTerms {
+ private:
+  vector<array<uint8_t, 4>> letters;
+  vector<uint32_t> counts;
+  bool histogram;
+
+  // Every term containing each cipher letter (sorted, without duplicates)
+  vector<uint32_t> byLetter[26];
+
+ public:
+  QuadgramTerms(const vector<uint8_t>& ciphertext,
+                ScoringMode mode = ScoringMode::Auto);
+
+  /**
+   * Returns the score of term `term` decrypted with `key`.
+   */
+  double termScore(const QuadgramScorer& scorer, const SubstKey& key,
+                   uint32_t term) const noexcept {
+    const array<uint8_t, 4>& q = letters[term];
+    size_t idx = ((key[q[0]] * 26 + key[q[1]]) * 26 + key[q[2]]) * 26 +
+                 key[q[3]];
+    return counts[term] * scorer.getIndexScore(idx);
+  }
+
+  /**
+   * Same as `termScore`, in `table`'s units.
+   */
+  template <class Table>
+  typename Table::Sum termValue(const Table& table, const SubstKey& key,
+                                uint32_t term) const noexcept {
+    const array<uint8_t, 4>& q = letters[term];
+    size_t idx = ((key[q[0]] * 26 + key[q[1]]) * 26 + key[q[2]]) * 26 +
+                 key[q[3]];
+    return counts[term] * table[idx];
+  }
+
+  /**
+   * Returns the score of the whole text decrypted with `key`, summed in term
+   * order. In position form this equals `scoreIndices` of the decryption.
+   */
+  double score(const QuadgramScorer& scorer, const SubstKey& key) const;
+
+  const vector<uint32_t>& termsWith(int letter) const {
+    return byLetter[letter];
+  }
+
+  size_t size() const {
+    return letters.size();
+  }
+
+  bool isHistogram() const {
+    return histogram;
+  }
+};
+
+/**
+ * Tracks the score of a ciphertext's `QuadgramTerms` under a substitution
+ * key, so that swapping two key entries only rescores the terms containing
+ * the two swapped cipher letters instead of the whole text.
+ *
+ * A swap is made with `trySwap` and stays pending until it is either kept
+ * with `commit` or undone with `rollback`. `terms` must outlive the scorer,
+ * and may be shared by any number of them.
+ *
+ * Scores are sums of `Table` entries (see `QuadgramTable`); with the default
+ * full-precision table they are log likelihoods, and equal `terms.score`.
+ */
+template <class Table = QuadgramTable<double>>
+class IncrementalScorer {
+ public:
+  using Sum = typename Table::Sum;
+
+ private:
+  Table table;
+  const QuadgramTerms& terms;
+  SubstKey key;
+  Sum currentScore;
+
+  // State of the pending swap
+  vector<uint32_t> affected;
+  Sum pendingScore;
+  int pending1;
+  int pending2;
+  uint64_t scored;
+
+  Sum scoreAffected() const;
+
+ public:
+  IncrementalScorer(const QuadgramScorer& scorer, const QuadgramTerms& terms,
+                    const SubstKey& key);
+
+  /**
+   * Swaps the key entries for cipher letters `letter1` and `letter2` (0 to 25)
+   * and returns the score of the text under the new key.
+   */
+  Sum trySwap(int letter1, int letter2);
+
+  /**
+   * Keeps the pending swap.
+   */
+  void commit();
+
+  /**
+   * Undoes the pending swap.
+   */
+  void rollback();
+
+  Sum getScore() const {
+    return currentScore;
+  }
+
+  const Table& getTable() const {
+    return table;
+  }
+
+  const SubstKey& getKey() const {
+    return key;
+  }
+
+  /**
+   * Quadgram terms scored so far, including the initial full score.
+   */
+  uint64_t quadgramsScored() const {
+    return scored;
+  }
+};
+
+extern template class IncrementalScorer<QuadgramTable<double>>;
+extern template class IncrementalScorer<QuadgramTable<float>>;
+extern template class IncrementalScorer<QuadgramTable<int16_t>>;
+extern template class IncrementalScorer<QuadgramTable<uint8_t>>;
+
+/**
+ * A fixed-size table of key scores, shared by every restart and thread of one
+ * solve, so a swap back to a key some restart has already scored can be
+ * turned down without rescoring it.
+ *
+ * Keys are found by their Zobrist hash: the XOR of one random 64-bit number
+ * per (cipher letter, plain letter) pair, so a swap updates the hash with
+ * four XORs (see `swapHash`). Each slot holds a score and its hash XORed with
+ * the score's bits, and is read and written with relaxed atomics, so the
+ * table needs no locks: a slot torn by two writers just fails the check and
+ * reads as a miss. A new score always replaces the old one in its slot.
+ *
+ * Scores found by different paths to the same key can differ in their last
+ * bits, so the solver only trusts a cached score to turn down a swap that is
+ * clearly worse (see `SCORE_CACHE_MARGIN`), and rescores everything else.
+ * That way the cache never changes which key a solve returns.
+ */
+class ScoreCache {
+ private:
+  struct Slot {
+    atomic<uint64_t> check{0};
+    atomic<uint64_t> bits{0};
+  };
+  unique_ptr<Slot[]> slots;
+  size_t mask;
+
+ public:
+  /**
+   * An empty table of 2^`bits` slots (16 bytes each). Throws invalid_argument
+   * unless `bits` is 1 to 30.
+   */
+  explicit ScoreCache(int bits);
+
+  /**
+   * The Zobrist hash of `key`.
+   */
+  static uint64_t hash(const SubstKey& key);
+
+  /**
+   * What to XOR into the hash of `key` to get the hash of `key` with the
+   * entries for cipher letters `letter1` and `letter2` swapped.
+   */
+  static uint64_t swapHash(const SubstKey& key, int letter1, int letter2);
+
+  /**
+   * Sets `score` to the score stored for `hash` and returns true, or returns
+   * false if it isn't in the table.
+   */
+  bool find(uint64_t hash, double& score) const noexcept;
+
+  void store(uint64_t hash, double score) noexcept;
+
+  size_t size() const {
+    return mask + 1;
+  }
+};
+
+/**
+ * How much worse than the current score, relative to it, a cached score has
+ * to be before the solver turns a swap down on it alone. Far above the
+ * rounding that separates two paths to the same key.
+ */
+const double SCORE_CACHE_MARGIN = 1e-9;
+
+/**
+ * A solver restart's best key and its score over the whole ciphertext.
+ */
+struct RestartResult {
+  SubstKey key;
+  double score;
+  RestartCounters counters;
+};
+
+/**
+ * Number of restarts `solveSubstKey` runs for `options`.
+ */
+int restartCount(const SolverOptions& options);
+
+/**
+ * Runs restart `restart` of a solve that drew `seed`, on `ciphertext` and its
+ * `terms`. The result depends only on those, `options` (including
+ * `options.job`) and `scorer`, not on which thread or machine runs it or what
+ * ran before. Running restarts 0 to `restartCount(options) - 1` anywhere and
+ * combining them with `bestRestart` gives exactly the key `solveSubstKey`
+ * returns when it draws `seed`.
+ *
+ * Caps the restart at `options.swapLimit` swaps, and ignores
+ * `options.sampleLetters`, `options.timeLimit` and `options.agreeRestarts`.
+ */
+RestartResult solveSubstRestart(const QuadgramScorer& scorer,
+                                const vector<uint8_t>& ciphertext,
+                                const QuadgramTerms& terms, uint32_t seed,
+                                uint32_t restart,
+                                const SolverOptions& options = SolverOptions());
+
+/**
+ * Returns the key of the highest scoring result. Ties go to the earliest, so
+ * the answer doesn't depend on the order results arrived in, only on their
+ * positions. Returns an empty key if no result has a score above -infinity.
+ */
+SubstKey bestRestart(const vector<RestartResult>& results);
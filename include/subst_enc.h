@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -16,6 +18,54 @@ using namespace std;
  */
 string applySubstCipher(const vector<char>& cipher, const string& s);
 
+/**
+ * A substitution cipher in compact form: entry `i` holds the index (0 to 25)
+ * of the letter that the `i`th letter of the alphabet is replaced with.
+ */
+using SubstKey = array<uint8_t, 26>;
+
+/**
+ * Converts a cipher of 26 uppercase letters to a `SubstKey`, and back.
+ */
+SubstKey toSubstKey(const vector<char>& cipher);
+vector<char> fromSubstKey(const SubstKey& key);
+
+/**
+ * Applies `key` to the `n` letter indices (0 to 25) in `in`, writing the
+ * result to `out`. `in` and `out` may point to the same buffer.
+ */
+void applySubstKey(const SubstKey& key, const uint8_t* in, uint8_t* out,
+                   size_t n);
+
+/**
+ * Same as `applySubstCipher`, but takes the cipher as a `SubstKey`.
+ */
+string applySubstKey(const SubstKey& key, const string& s);
+
+/**
+ * Returns the key that undoes `key`.
+ */
+SubstKey invertSubstKey(const SubstKey& key);
+
+/**
+ * Applies `key` to the file at `inputPath` and writes the result to
+ * `outputPath`, a chunk at a time so memory use doesn't depend on the file's
+ * size. Like `applySubstKey`, non-letters are left alone.
+ *
+ * The output is written to a new file and renamed into place at the end, so
+ * it may be the input itself. Returns false, leaving the output as it was, if
+ * either file couldn't be opened, read or written.
+ */
+bool applySubstKeyToFile(const SubstKey& key, const string& inputPath,
+                         const string& outputPath);
+
+/**
+ * Runs the substitution file routine. Prompts from the console input (cin)
+ * for the input file name, the output file name, the cipher (26 letters), and
+ * whether to encrypt or decrypt with it, then calls `applySubstKeyToFile`.
+ */
+void applySubstFileCommand();
+
 /**
  * Runs the random substitution cipher encryption routine. Prompts from the
  * console input (cin) once to get the text to encrypt. Outputs the text after
@@ -0,0 +1,377 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "include/batch.h"
+#include "include/caesar_dec.h"
+#include "include/pool.h"
+#include "include/subst_dec.h"
+#include "tests/test_utils.h"
+#include "utils.h"
+
+using ::testing::ContainerEq;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::HasSubstr;
+using ::testing::StrEq;
+
+namespace {
+
+const string INPUT_DIR = "test_batch_in";
+const string OUTPUT_DIR = "test_batch_out";
+
+string readFile(const string& path) {
+  ifstream file(path);
+  stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+TEST(Batch_Pool, RunsNestedTasks) {
+  for (int threads : {1, 4}) {
+    atomic<int> outer(0);
+    vector<atomic<int>> inner(50 * 20);
+    {
+      WorkStealingPool pool(threads);
+      for (int task = 0; task < 50; task++) {
+        pool.submit([&, task] {
+          outer++;
+          // Splits onto the pool's idle workers
+          parallelFor(20, 1, [&](size_t i) { inner[task * 20 + i]++; });
+        });
+      }
+      pool.wait();
+      ASSERT_THAT(outer.load(), Eq(50)) << threads << " threads";
+    }
+
+    for (atomic<int>& count : inner) {
+      ASSERT_THAT(count.load(), Eq(1)) << threads << " threads";
+    }
+  }
+}
+
+TEST(Batch_Pool, ParallelForReusesThreads) {
+  mutex lock;
+  set<thread::id> ids;
+  for (int call = 0; call < 20; call++) {
+    vector<atomic<int>> counts(64);
+    parallelFor(counts.size(), 4, [&](size_t i) {
+      counts[i]++;
+      lock_guard<mutex> guard(lock);
+      ids.insert(this_thread::get_id());
+    });
+    for (atomic<int>& count : counts) {
+      ASSERT_THAT(count.load(), Eq(1));
+    }
+  }
+  // The caller and the shared pool's workers, however many calls there were
+  ASSERT_LE(ids.size(), 1 + sharedPool().size());
+  ASSERT_TRUE(ids.count(this_thread::get_id()));
+}
+
+TEST(Batch_ExpandInputs, Globs) {
+  std::filesystem::create_directory(INPUT_DIR);
+  ofstream(INPUT_DIR + "/b.txt") << "b";
+  ofstream(INPUT_DIR + "/a.txt") << "a";
+  ofstream(INPUT_DIR + "/c.md") << "c";
+
+  ASSERT_THAT(expandInputs({INPUT_DIR + "/*.txt", "missing_*.txt", "plain"}),
+              ElementsAre(INPUT_DIR + "/a.txt", INPUT_DIR + "/b.txt",
+                          "missing_*.txt", "plain"));
+
+  std::filesystem::remove_all(INPUT_DIR);
+}
+
+TEST(Batch_Decrypt, SameKeysForAnyThreadCount) {
+  std::filesystem::create_directory(INPUT_DIR);
+  std::filesystem::copy_file("test_data/fire_ice_enc.txt",
+                             INPUT_DIR + "/fire.txt");
+  ofstream(INPUT_DIR + "/ice.txt") << applySubstCipher(
+      genRandomSubstCipher(), readFile("plaintext.txt").substr(0, 2000));
+  ofstream(INPUT_DIR + "/blank.txt") << "1234\n";
+  vector<string> inputs = {INPUT_DIR + "/fire.txt", INPUT_DIR + "/ice.txt",
+                           INPUT_DIR + "/blank.txt",
+                           INPUT_DIR + "/missing.txt"};
+
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  SolverOptions options;
+  options.restarts = 4;
+
+  map<string, string> firstOutputs;
+  for (int threads : {1, 3}) {
+    options.threads = threads;
+    map<string, string> keys;
+    Random::seed(5);
+    BatchSummary summary = batchDecryptFiles(
+        scorer, inputs, OUTPUT_DIR, options, [&](const BatchResult& result) {
+          keys[result.input] = result.ok ? batchResultJson(result) : "";
+          ASSERT_THAT(result.ok, Eq(result.error.empty()));
+        });
+
+    ASSERT_THAT(summary.files, Eq(4u));
+    ASSERT_THAT(summary.failed, Eq(2u));
+    ASSERT_THAT(keys.size(), Eq(4u));
+    ASSERT_THAT(keys[inputs[2]], StrEq(""));
+
+    map<string, string> outputs;
+    for (const char* name : {"fire.txt", "ice.txt"}) {
+      outputs[name] = readFile(OUTPUT_DIR + "/" + name);
+      ASSERT_FALSE(outputs[name].empty()) << name;
+    }
+    if (firstOutputs.empty()) {
+      firstOutputs = outputs;
+    } else {
+      ASSERT_THAT(outputs, ContainerEq(firstOutputs))
+          << "Different decryptions with " << threads << " threads";
+    }
+    std::filesystem::remove_all(OUTPUT_DIR);
+  }
+
+  std::filesystem::remove_all(INPUT_DIR);
+}
+
+TEST(Batch_Decrypt, FailsSameNameAndUnwritable) {
+  std::filesystem::create_directories(INPUT_DIR + "/a");
+  std::filesystem::create_directories(INPUT_DIR + "/b");
+  // In the way of y.txt's output, so writing it fails after the solve
+  std::filesystem::create_directories(OUTPUT_DIR + "/y.txt");
+  string text = applySubstCipher(genRandomSubstCipher(),
+                                 readFile("plaintext.txt").substr(0, 500));
+  for (const char* name : {"/a/x.txt", "/b/x.txt", "/y.txt"}) {
+    ofstream(INPUT_DIR + name) << text;
+  }
+  vector<string> inputs = {INPUT_DIR + "/a/x.txt", INPUT_DIR + "/b/x.txt",
+                           INPUT_DIR + "/y.txt"};
+
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  SolverOptions options;
+  options.restarts = 1;
+  map<string, string> errors;
+  BatchSummary summary = batchDecryptFiles(
+      scorer, inputs, OUTPUT_DIR, options,
+      [&](const BatchResult& result) { errors[result.input] = result.error; });
+
+  ASSERT_THAT(summary.failed, Eq(2u));
+  ASSERT_THAT(summary.letters, Eq(cleanToIndices(text).size()));
+  ASSERT_THAT(errors[inputs[0]], StrEq(""));
+  ASSERT_THAT(errors[inputs[1]], StrEq("Same file name as " + inputs[0]));
+  ASSERT_THAT(errors[inputs[2]], HasSubstr("Couldn't write"));
+
+  std::filesystem::remove_all(INPUT_DIR);
+  std::filesystem::remove_all(OUTPUT_DIR);
+}
+
+TEST(Batch_Decrypt, KeepsInputsInOutputDir) {
+  std::filesystem::create_directory(INPUT_DIR);
+  string text = applySubstCipher(genRandomSubstCipher(),
+                                 readFile("plaintext.txt").substr(0, 500));
+  ofstream(INPUT_DIR + "/x.txt") << text;
+
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  SolverOptions options;
+  options.restarts = 1;
+  vector<string> errors;
+  BatchSummary summary = batchDecryptFiles(
+      scorer, {INPUT_DIR + "/x.txt"}, INPUT_DIR + "/.", options,
+      [&](const BatchResult& result) { errors.push_back(result.error); });
+
+  ASSERT_THAT(summary.failed, Eq(1u));
+  ASSERT_THAT(errors, ElementsAre("Output would replace the input"));
+  ASSERT_THAT(readFile(INPUT_DIR + "/x.txt"), StrEq(text));
+
+  std::filesystem::remove_all(INPUT_DIR);
+}
+
+TEST(Batch_Decrypt, Json) {
+  BatchResult result;
+  result.input = "in/a.txt";
+  result.output = "out/a.txt";
+  result.error = "Couldn't read in/a.txt";
+  ASSERT_THAT(batchResultJson(result),
+              StrEq("{\"input\": \"in/a.txt\", \"output\": \"out/a.txt\", "
+                    "\"ok\": false, \"error\": \"Couldn't read in/a.txt\"}"));
+
+  BatchSummary summary;
+  summary.files = 4;
+  summary.failed = 1;
+  summary.letters = 1000;
+  summary.bytes = 1200;
+  summary.seconds = 2;
+  ASSERT_THAT(batchSummaryJson(summary),
+              StrEq("{\"files\": 4, \"failed\": 1, \"letters\": 1000, "
+                    "\"seconds\": 2, \"files_per_second\": 2, "
+                    "\"letters_per_second\": 500, \"bytes_per_second\": "
+                    "600}"));
+}
+
+// `count` slices of `length` letters of plaintext.txt, each encrypted with
+// its own random key
+vector<string> shortMessages(size_t count, size_t length,
+                             vector<string>& plaintexts) {
+  string text = clean(readFile("plaintext.txt"));
+  vector<string> messages;
+  for (size_t i = 0; i < count; i++) {
+    plaintexts.push_back(text.substr(i * 300, length));
+    messages.push_back(
+        applySubstCipher(genRandomSubstCipher(), plaintexts.back()));
+  }
+  return messages;
+}
+
+TEST(Batch_SolveMessages, DecryptsShortMessages) {
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  Random::seed(2);
+  vector<string> plaintexts;
+  vector<string> messages = shortMessages(8, 200, plaintexts);
+
+  vector<vector<char>> keys = decryptSubstCiphers(scorer, messages);
+
+  ASSERT_THAT(keys.size(), Eq(messages.size()));
+  size_t correct = 0;
+  for (size_t i = 0; i < messages.size(); i++) {
+    string decrypted = applySubstCipher(keys[i], messages[i]);
+    for (size_t j = 0; j < decrypted.size(); j++) {
+      correct += decrypted[j] == plaintexts[i][j];
+    }
+  }
+  ASSERT_GE(correct, 0.9 * 8 * 200);
+}
+
+TEST(Batch_SolveMessages, SameKeysForAnyThreadCount) {
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  vector<string> plaintexts;
+  vector<string> messages = shortMessages(11, 60, plaintexts);
+  // Too short to score, and lengths that leave lanes padded
+  messages.insert(messages.end(), {"", "abc", "the end", "It was a dark"});
+  SolverOptions options;
+  options.restarts = 3;
+
+  vector<vector<char>> firstKeys;
+  for (int threads : {1, 3}) {
+    options.threads = threads;
+    Random::seed(5);
+    vector<vector<char>> keys = decryptSubstCiphers(scorer, messages, options);
+    ASSERT_THAT(keys.size(), Eq(messages.size()));
+    for (vector<char> key : keys) {
+      sort(key.begin(), key.end());
+      ASSERT_THAT(string(key.begin(), key.end()),
+                  StrEq("ABCDEFGHIJKLMNOPQRSTUVWXYZ"));
+    }
+    if (firstKeys.empty()) {
+      firstKeys = keys;
+    } else {
+      ASSERT_THAT(keys, ContainerEq(firstKeys))
+          << "Different keys with " << threads << " threads";
+    }
+  }
+
+  // Each message only depends on its own streams, not on which messages
+  // shared its lanes
+  Random::seed(5);
+  vector<vector<char>> fewer = decryptSubstCiphers(
+      scorer, {messages.begin(), messages.begin() + 5}, options);
+  ASSERT_THAT(fewer, ContainerEq(vector<vector<char>>(firstKeys.begin(),
+                                                      firstKeys.begin() + 5)));
+}
+
+TEST(Batch_SolveMessages, SameBudgetsAndStreamsAsOneByOne) {
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  vector<string> plaintexts;
+  vector<string> texts = shortMessages(9, 80, plaintexts);
+  texts.push_back("ab");
+  vector<vector<uint8_t>> messages;
+  for (const string& text : texts) {
+    messages.push_back(cleanToIndices(text));
+  }
+
+  SolverOptions timed;
+  timed.timeLimit = 1e-9;
+  timed.restarts = 4;
+  SolverOptions capped;
+  capped.swapLimit = 1;
+  capped.rng = RngEngine::Xoshiro;
+  SolverOptions agreed;
+  agreed.agreeRestarts = 1;
+  agreed.restarts = 4;
+  agreed.rng = RngEngine::Mt19937;
+
+  for (const SolverOptions& options : {timed, capped, agreed}) {
+    Random::seed(5);
+    vector<SubstKey> keys = solveSubstKeys(scorer, messages, options);
+    ASSERT_THAT(keys.size(), Eq(messages.size()));
+    for (size_t i = 0; i < messages.size(); i++) {
+      SolverOptions job = options;
+      job.job = i;
+      Random::seed(5);
+      ASSERT_THAT(keys[i], ContainerEq(solveSubstKey(scorer, messages[i], job)))
+          << "Message " << i;
+    }
+  }
+}
+
+class Batch_MainCommand : public CaptureCinCout {};
+
+TEST_F(Batch_MainCommand, Menu) {
+  input << "b" << endl;
+  input << "test_data/fire_ice_enc.txt missing.txt" << endl;
+  input << OUTPUT_DIR << endl;
+  input << "x" << endl;
+
+  ciphers_main();
+
+  string actual_output = output.str();
+  ASSERT_THAT(actual_output,
+              HasSubstr("Decrypted test_data/fire_ice_enc.txt to " +
+                        OUTPUT_DIR + "/fire_ice_enc.txt"));
+  ASSERT_THAT(actual_output, HasSubstr("Failed missing.txt: Couldn't read"));
+  ASSERT_THAT(actual_output, HasSubstr("2 files, 1 failed, 210 letters"));
+  ASSERT_THAT(readFile(OUTPUT_DIR + "/fire_ice_enc.txt"),
+              StrEq(readFile("test_data/fire_ice_dec.txt")));
+
+  std::filesystem::remove_all(OUTPUT_DIR);
+}
+
+TEST_F(Batch_MainCommand, CommandLine) {
+  char program[] = "ciphers_main";
+  string batch = "--batch=" + OUTPUT_DIR;
+  char input_file[] = "test_data/fire_ice_enc.txt";
+  char* argv[] = {program, batch.data(), input_file, nullptr};
+
+  ASSERT_THAT(ciphers_main(3, argv), Eq(0));
+
+  string actual_output = output.str();
+  ASSERT_THAT(actual_output,
+              HasSubstr("{\"input\": \"test_data/fire_ice_enc.txt\", "
+                        "\"output\": \"" +
+                        OUTPUT_DIR + "/fire_ice_enc.txt\", \"ok\": true"));
+  ASSERT_THAT(actual_output, HasSubstr("{\"files\": 1, \"failed\": 0"));
+  ASSERT_THAT(readFile(OUTPUT_DIR + "/fire_ice_enc.txt"),
+              StrEq(readFile("test_data/fire_ice_dec.txt")));
+
+  std::filesystem::remove_all(OUTPUT_DIR);
+}
+
+TEST_F(Batch_MainCommand, FilesNeedBatch) {
+  char program[] = "ciphers_main";
+  char serve[] = "--serve";
+  char input_file[] = "test_data/fire_ice_enc.txt";
+
+  char* argv[] = {program, input_file, nullptr};
+  ASSERT_THAT(ciphers_main(2, argv), Eq(1));
+  char* serveArgv[] = {program, serve, input_file, nullptr};
+  ASSERT_THAT(ciphers_main(3, serveArgv), Eq(1));
+  // Nothing ran, not even the menu
+  ASSERT_THAT(output.str(), StrEq(""));
+}
+
+}  // namespace
@@ -71,6 +71,11 @@ INSTANTIATE_TEST_SUITE_P(, CaesarDec_Clean,
                                 make_tuple("1234567890!@#$%^&*() .,", ""),
                                 make_tuple("a-b C", "ABC")));
 
+TEST(CaesarDec_CleanToIndices, Case) {
+  ASSERT_THAT(cleanToIndices(""), IsEmpty());
+  ASSERT_THAT(cleanToIndices("a-b C z"), ElementsAreArray({0, 1, 2, 25}));
+}
+
 class CaesarDec_SplitSpaces
     : public TestWithParam<tuple<string, vector<string>>> {};
 
@@ -140,6 +145,55 @@ INSTANTIATE_TEST_SUITE_P(
                                      "R", "W"},
                       3)));
 
+TEST(CaesarDec_Dictionary, Lookups) {
+  Dictionary dict({"CAT", "COOKIE", "IN", "THE", "CAT", ""});
+
+  ASSERT_THAT(dict.size(), Eq(6));
+  ASSERT_TRUE(dict.contains("CAT"));
+  ASSERT_TRUE(dict.contains("COOKIE"));
+  ASSERT_TRUE(dict.contains(""));
+  ASSERT_FALSE(dict.contains("CA"));
+  ASSERT_FALSE(dict.contains("CATS"));
+  ASSERT_FALSE(dict.contains("cat"));
+
+  string text = "THE CAT IN THE ZZYZX";
+  vector<string_view> views = {string_view(text).substr(0, 3),
+                               string_view(text).substr(4, 3),
+                               string_view(text).substr(15, 5)};
+  ASSERT_THAT(numWordsIn(views, dict), Eq(2));
+  ASSERT_THAT(numWordsIn(vector<string>{"THE", "CAT", "IN", "THE", "ZZYZX"},
+                         dict),
+              Eq(4));
+}
+
+TEST(CaesarDec_Dictionary, LoadsFullDictionary) {
+  Dictionary dict = Dictionary::load("dictionary.txt");
+
+  ASSERT_THAT(dict.size(), Eq(4107));
+  ASSERT_TRUE(dict.contains("ABILITY"));
+  ASSERT_TRUE(dict.contains("A"));
+  ASSERT_FALSE(dict.contains("ZZYZX"));
+}
+
+TEST(CaesarDec_RankShifts, EnglishTextRanksFirst) {
+  string plaintext =
+      "WHEN IN THE COURSE OF HUMAN EVENTS IT BECOMES NECESSARY FOR ONE "
+      "PEOPLE TO DISSOLVE THE POLITICAL BANDS WHICH HAVE CONNECTED THEM";
+
+  for (int shift : {0, 1, 13, 25}) {
+    // Encrypting by `shift` means rotating by 26 - `shift` decrypts
+    vector<uint8_t> letters = cleanToIndices(rot(plaintext, shift));
+    ASSERT_THAT(rankCaesarShifts(letters)[0], Eq((26 - shift) % 26))
+        << "Wrong best rotation for text encrypted with shift " << shift;
+  }
+}
+
+TEST(CaesarDec_FindShifts, ShortTextChecksEveryShift) {
+  Dictionary dict({"BY", "HE", "IF", "NA"});
+
+  ASSERT_THAT(findCaesarShifts({"NK"}, dict), ElementsAreArray({14, 20, 21}));
+}
+
 // These tests use a custom dictionary, since they call the command directly.
 
 class CaesarDec_CustomDictCommand
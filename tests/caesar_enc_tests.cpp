@@ -1,7 +1,10 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <map>
 #include <string>
 
@@ -132,4 +135,92 @@ TEST_F(CaesarEnc_MainCommand, Main) {
   ASSERT_THAT(actual_output, HasSubstr(expected_enc)) << "Incorrect encryption";
 }
 
+string readFile(const string& path) {
+  ifstream file(path);
+  stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+TEST(CaesarEnc_RotFile, KeepsLayout) {
+  const string input_file = "test_rot_in.txt";
+  const string output_file = "test_rot_out.txt";
+  ofstream(input_file) << "Qeb nrfzh,\nyoltk clu!\n";
+
+  ASSERT_TRUE(rotFile(input_file, output_file, 3));
+  ASSERT_THAT(readFile(output_file), StrEq("THE QUICK,\nBROWN FOX!\n"));
+
+  ASSERT_TRUE(rotFile(output_file, input_file, -3));
+  ASSERT_THAT(readFile(input_file), StrEq("QEB NRFZH,\nYOLTK CLU!\n"));
+
+  std::filesystem::remove(input_file);
+  std::filesystem::remove(output_file);
+  ASSERT_FALSE(rotFile(input_file, output_file, 3))
+      << "Missing input file should fail";
+  std::filesystem::remove(output_file);
+}
+
+TEST(CaesarEnc_RotFile, InPlace) {
+  const string input_file = "test_rot_in.txt";
+  ofstream(input_file) << "Qeb nrfzh!\n";
+
+  ASSERT_TRUE(rotFile(input_file, input_file, 3));
+  ASSERT_THAT(readFile(input_file), StrEq("THE QUICK!\n"));
+
+  // A failed write leaves the old output and no stray files
+  const string output_file = "test_rot_out.txt";
+  ofstream(output_file) << "old";
+  ASSERT_FALSE(rotFile("test_rot_missing.txt", output_file, 3));
+  ASSERT_THAT(readFile(output_file), StrEq("old"));
+  for (const auto& entry : std::filesystem::directory_iterator(".")) {
+    ASSERT_THAT(entry.path().filename().string().rfind("test_rot_out.txt.", 0),
+                Eq(string::npos))
+        << entry.path();
+  }
+
+  std::filesystem::remove(input_file);
+  std::filesystem::remove(output_file);
+}
+
+TEST(CaesarEnc_RotFile, SpansChunks) {
+  const string input_file = "test_rot_in.txt";
+  const string output_file = "test_rot_out.txt";
+  string text;
+  for (int i = 0; text.size() < 3 * 1000 * 1000; i++) {
+    text += "the quick brown fox jumps over the lazy dog " + to_string(i) +
+            "\n";
+  }
+  ofstream(input_file) << text;
+
+  ASSERT_TRUE(rotFile(input_file, output_file, 13));
+  string expected = text;
+  for (char& c : expected) {
+    c = rot((char)toupper(c), 13);
+  }
+  ASSERT_TRUE(readFile(output_file) == expected)
+      << "Multi-chunk file wasn't rotated byte for byte";
+
+  std::filesystem::remove(input_file);
+  std::filesystem::remove(output_file);
+}
+
+TEST_F(CaesarEnc_MainCommand, File) {
+  const string input_file = "test_rot_in.txt";
+  const string output_file = "test_rot_out.txt";
+  ofstream(input_file) << "QEB NRFZH YOLTK CLU\n";
+
+  input << "g" << endl;
+  input << input_file << endl;
+  input << output_file << endl;
+  input << "3" << endl;
+  input << "x" << endl;
+
+  ciphers_main();
+
+  string actual = readFile(output_file);
+  std::filesystem::remove(input_file);
+  std::filesystem::remove(output_file);
+  ASSERT_THAT(actual, StrEq("THE QUICK BROWN FOX\n"));
+}
+
 }  // namespace
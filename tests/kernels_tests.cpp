@@ -0,0 +1,197 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cctype>
+#include <random>
+#include <string>
+
+#include "include/caesar_enc.h"
+#include "include/kernels.h"
+#include "include/subst_dec.h"
+#include "tests/test_utils.h"
+
+using ::testing::ElementsAreArray;
+using ::testing::Eq;
+using ::testing::StrEq;
+
+namespace {
+
+const char ROT_13[] = "NOPQRSTUVWXYZABCDEFGHIJKLM";
+
+// Byte-at-a-time versions of the kernels, written the way the original
+// encoders were
+string expectedLetters(const string& s) {
+  string result;
+  for (char c : s) {
+    result += isalpha((unsigned char)c) ? ROT_13[toupper(c) - 'A'] : c;
+  }
+  return result;
+}
+
+string expectedWords(const string& s) {
+  string result;
+  for (char c : s) {
+    if (isalpha((unsigned char)c)) {
+      result += ROT_13[toupper(c) - 'A'];
+    } else if (isspace((unsigned char)c)) {
+      result += ' ';
+    }
+  }
+  return result;
+}
+
+string expectedCompact(const string& s, char base) {
+  string result;
+  for (char c : s) {
+    if (isalpha((unsigned char)c)) {
+      result += (char)(base + toupper(c) - 'A');
+    }
+  }
+  return result;
+}
+
+// Every byte value, then random text with plenty of punctuation, at lengths
+// that end mid-block for every vector width
+vector<string> kernelInputs() {
+  vector<string> inputs;
+  string allBytes;
+  for (int c = 0; c < 256; c++) {
+    allBytes += (char)c;
+  }
+  inputs.push_back(allBytes);
+
+  std::mt19937 rng(7);
+  const string pool = "The quick, brown FOX!\n\tjumps @ [over] `the` {lazy} dog";
+  for (size_t length = 0; length < 100; length++) {
+    string s;
+    for (size_t i = 0; i < length; i++) {
+      s += pool[rng() % pool.size()];
+    }
+    inputs.push_back(s);
+  }
+
+  // Long runs of clean prose take the whole-block path
+  inputs.push_back(string(100, 'a') + "HELLO world " + string(70, ' '));
+  inputs.push_back(string(200, 'Q') + "!" + string(64, 'z'));
+  return inputs;
+}
+
+class Kernels_Translate
+    : public testing::TestWithParam<tuple<SimdLevel, string>> {
+ protected:
+  SimdLevel level() const {
+    return get<0>(GetParam());
+  }
+};
+
+TEST_P(Kernels_Translate, Letters) {
+  for (const string& s : kernelInputs()) {
+    string out(s.size(), '\0');
+    translateLetters(ROT_13, s.data(), out.data(), s.size(), level());
+    ASSERT_THAT(out, StrEq(expectedLetters(s)));
+
+    // In place
+    string inPlace = s;
+    translateLetters(ROT_13, inPlace.data(), inPlace.data(), inPlace.size(),
+                     level());
+    ASSERT_THAT(inPlace, StrEq(expectedLetters(s)));
+  }
+}
+
+TEST_P(Kernels_Translate, Words) {
+  for (const string& s : kernelInputs()) {
+    string out(s.size(), '\0');
+    out.resize(
+        translateWords(ROT_13, s.data(), out.data(), s.size(), level()));
+    ASSERT_THAT(out, StrEq(expectedWords(s)));
+  }
+}
+
+TEST_P(Kernels_Translate, MatchesRot) {
+  for (const string& s : kernelInputs()) {
+    string out(s.size(), '\0');
+    out.resize(
+        translateWords(ROT_13, s.data(), out.data(), s.size(), level()));
+    ASSERT_THAT(out, StrEq(rot(s, 13)));
+  }
+}
+
+TEST_P(Kernels_Translate, CompactLetters) {
+  for (const string& s : kernelInputs()) {
+    for (char base : {'A', '\0'}) {
+      string out(s.size(), '\0');
+      out.resize(compactLetters(s.data(), out.data(), s.size(), base, level()));
+      ASSERT_EQ(out, expectedCompact(s, base));
+
+      // In place
+      string inPlace = s;
+      inPlace.resize(compactLetters(inPlace.data(), inPlace.data(),
+                                    inPlace.size(), base, level()));
+      ASSERT_EQ(inPlace, expectedCompact(s, base));
+    }
+  }
+}
+
+class Kernels_Lanes : public Kernels_Translate {};
+
+// Interleaved lanes of random text, with lengths from empty to as long as
+// the rows go, each decrypted under its own random key
+TEST_P(Kernels_Lanes, ScoreSwapLanes) {
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  std::mt19937 rng(11);
+  const size_t rows = 70;
+  const int32_t lengths[SCORE_LANES] = {0, 3, 4, 5, 17, 40, 64, 70};
+  vector<int32_t> cipher(rows * SCORE_LANES, 26);
+  vector<int32_t> plain(rows * SCORE_LANES, 0);
+  vector<int32_t> trial(rows * SCORE_LANES);
+  int32_t letter1[SCORE_LANES];
+  int32_t letter2[SCORE_LANES];
+  int32_t flip[SCORE_LANES];
+  vector<vector<uint8_t>> expected(SCORE_LANES);
+  for (size_t lane = 0; lane < SCORE_LANES; lane++) {
+    SubstKey key = toSubstKey(genRandomSubstCipher(rng));
+    letter1[lane] = rng() % 26;
+    letter2[lane] = (letter1[lane] + 1 + rng() % 25) % 26;
+    flip[lane] = key[letter1[lane]] ^ key[letter2[lane]];
+
+    SubstKey swapped = key;
+    swap(swapped[letter1[lane]], swapped[letter2[lane]]);
+    for (int32_t p = 0; p < lengths[lane]; p++) {
+      const size_t at = p * SCORE_LANES + lane;
+      cipher[at] = rng() % 26;
+      plain[at] = key[cipher[at]];
+      expected[lane].push_back(swapped[cipher[at]]);
+    }
+  }
+
+  double scores[SCORE_LANES];
+  scoreSwapLanes(scorer.table(), cipher.data(), plain.data(), trial.data(),
+                 rows, lengths, letter1, letter2, flip, scores, level());
+
+  for (size_t lane = 0; lane < SCORE_LANES; lane++) {
+    vector<uint8_t> letters;
+    for (int32_t p = 0; p < lengths[lane]; p++) {
+      letters.push_back(trial[p * SCORE_LANES + lane]);
+    }
+    ASSERT_THAT(letters, ElementsAreArray(expected[lane])) << "Lane " << lane;
+    // Summed in the same order, so exactly equal
+    ASSERT_THAT(scores[lane], Eq(scorer.scoreIndices(letters.data(),
+                                                     letters.size())))
+        << "Lane " << lane;
+  }
+}
+
+// Levels the CPU lacks fall back to the best one it has
+const auto LEVELS = testing::Values(make_tuple(SimdLevel::Scalar, "Scalar"),
+                                    make_tuple(SimdLevel::SSE41, "SSE41"),
+                                    make_tuple(SimdLevel::AVX2, "AVX2"),
+                                    make_tuple(SimdLevel::AVX512, "AVX512"));
+
+string levelName(const testing::TestParamInfo<tuple<SimdLevel, string>>& info) {
+  return last_elem(info.param);
+}
+
+INSTANTIATE_TEST_SUITE_P(, Kernels_Translate, LEVELS, levelName);
+INSTANTIATE_TEST_SUITE_P(, Kernels_Lanes, LEVELS, levelName);
+
+}  // namespace
@@ -0,0 +1,213 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "include/caesar_dec.h"
+#include "include/file_io.h"
+#include "include/server.h"
+#include "include/subst_dec.h"
+#include "tests/test_utils.h"
+#include "utils.h"
+
+using ::testing::ContainerEq;
+using ::testing::Eq;
+using ::testing::HasSubstr;
+using ::testing::StartsWith;
+
+namespace {
+
+const QuadgramScorer SCORER({"ABCD", "SCHO", "CHOO", "HOOL", "OOLS"},
+                            {1408, 1202417, 1140139, 104875, 345451});
+
+const Dictionary DICT({"HELLO", "WORLD", "SCHOOL"});
+
+string respond(const string& line) {
+  return handleRequest(parseJsonObject(line), DICT, SCORER, SolverOptions());
+}
+
+TEST(Server_Json, ParsesFlatObject) {
+  map<string, JsonValue> fields = parseJsonObject(
+      R"( {"op": "score", "id":7, "text": "a\"b\\c\né", "ok": true} )");
+
+  ASSERT_THAT(fields.size(), Eq(4u));
+  ASSERT_THAT(fields["op"].text, Eq("score"));
+  ASSERT_TRUE(fields["op"].isString);
+  ASSERT_THAT(fields["id"].text, Eq("7"));
+  ASSERT_FALSE(fields["id"].isString);
+  ASSERT_THAT(fields["text"].text, Eq("a\"b\\c\n\xC3\xA9"));
+  ASSERT_THAT(fields["ok"].text, Eq("true"));
+  ASSERT_TRUE(parseJsonObject("{}").empty());
+
+  fields = parseJsonObject(R"({"a": -0.5e+3, "b": 0, "c": null, "d": false})");
+  ASSERT_THAT(fields["a"].text, Eq("-0.5e+3"));
+  ASSERT_THAT(fields["b"].text, Eq("0"));
+}
+
+TEST(Server_Json, RejectsMalformed) {
+  for (const char* line :
+       {"", "[1]", "{\"op\": \"score\"", "{\"op\" \"score\"}",
+        "{\"op\": {\"a\": 1}}", "{\"text\": \"unterminated}", "{} extra",
+        "{\"id\": foo}", "{\"id\": tru}", "{\"n\": 01}", "{\"n\": 1.}",
+        "{\"n\": -}", "{\"n\": 1e}", "{\"n\": 0x10}"}) {
+    ASSERT_THROW(parseJsonObject(line), invalid_argument) << line;
+  }
+}
+
+TEST(Server_Json, EscapesStrings) {
+  string s = "quote \" slash \\ tab \t bell \x07";
+  ASSERT_THAT(jsonString(s),
+              Eq(R"("quote \" slash \\ tab \t bell \u0007")"));
+  ASSERT_THAT(parseJsonObject("{\"s\": " + jsonString(s) + "}")["s"].text,
+              Eq(s));
+}
+
+TEST(Server_Request, Ops) {
+  ASSERT_THAT(respond(R"({"op": "caesar_encrypt", "text": "Hello, World",
+                          "shift": 3})"),
+              Eq(R"("text": "KHOOR ZRUOG")"));
+  ASSERT_THAT(respond(R"({"op": "caesar_decrypt", "text": "KHOOR ZRUOG"})"),
+              Eq(R"("candidates": ["HELLO WORLD"])"));
+  ASSERT_THAT(respond(R"({"op": "subst_encrypt", "text": "Hello!",
+                          "key": "BCDEFGHIJKLMNOPQRSTUVWXYZA"})"),
+              Eq(R"("text": "IFMMP!", "key": "BCDEFGHIJKLMNOPQRSTUVWXYZA")"));
+
+  ostringstream score;
+  score.precision(10);
+  score << "\"score\": " << scoreString(SCORER, "SCHOOLS");
+  ASSERT_THAT(respond(R"({"op": "score", "text": "schools"})"),
+              Eq(score.str()));
+}
+
+TEST(Server_Request, Errors) {
+  ASSERT_THROW(respond(R"({"op": "nope", "text": ""})"), invalid_argument);
+  ASSERT_THROW(respond(R"({"op": "score"})"), invalid_argument);
+  ASSERT_THROW(respond(R"({"op": "subst_encrypt", "text": "A",
+                           "key": "AAAAAAAAAAAAAAAAAAAAAAAAAA"})"),
+               invalid_argument);
+}
+
+TEST(Server_Request, SeedOnlyDecidesItsOwnSolve) {
+  Random::seed(3);
+  vector<char> expected = genRandomSubstCipher();
+
+  Random::seed(3);
+  respond(R"({"op": "subst_decrypt", "text": "SCHOOLS", "seed": 7})");
+  ASSERT_THAT(genRandomSubstCipher(), ContainerEq(expected));
+
+  ASSERT_THROW(respond(R"({"op": "subst_decrypt", "text": "SCHOOLS",
+                           "restarts": 1000000000})"),
+               invalid_argument);
+}
+
+TEST(Server_Request, SeededDecryptRepeats) {
+  string request =
+      R"({"op": "subst_decrypt", "text": "SCHOOLS POOLSIDE SCHOOLS",
+          "seed": 7, "restarts": 6})";
+  ASSERT_THAT(respond(request), Eq(respond(request)));
+}
+
+// Runs `lines` through `serveStream` with `threads` workers, and returns the
+// response lines in the order they were written
+vector<string> serve(const string& lines, int threads) {
+  // A file, so input of any size is there before the server reads it
+  FILE* in = tmpfile();
+  int out[2];
+  EXPECT_NE(in, nullptr);
+  EXPECT_EQ(pipe(out), 0);
+  EXPECT_TRUE(writeAll(fileno(in), lines.data(), lines.size()));
+  EXPECT_EQ(lseek(fileno(in), 0, SEEK_SET), 0);
+
+  SolverOptions options;
+  options.threads = threads;
+  {
+    Server server(DICT, SCORER, options);
+    server.serveStream(fileno(in), out[1]);
+  }
+  fclose(in);
+  close(out[1]);
+
+  string output;
+  char chunk[4096];
+  for (ssize_t got; (got = read(out[0], chunk, sizeof(chunk))) > 0;) {
+    output.append(chunk, got);
+  }
+  close(out[0]);
+
+  vector<string> responses;
+  istringstream stream(output);
+  for (string line; getline(stream, line);) {
+    responses.push_back(line);
+  }
+  return responses;
+}
+
+TEST(Server_Stream, AnswersEveryRequest) {
+  string lines;
+  for (int i = 0; i < 200; i++) {
+    lines += "{\"id\": " + to_string(i) +
+             ", \"op\": \"caesar_encrypt\", \"text\": \"abc\", \"shift\": 1}\n";
+  }
+  lines += "not json\n";
+  lines += "{\"id\": \"last\", \"op\": \"score\", \"text\": \"school\"}";
+
+  for (int threads : {1, 4}) {
+    vector<string> responses = serve(lines, threads);
+    ASSERT_THAT(responses.size(), Eq(202u)) << threads << " threads";
+
+    vector<bool> seen(200);
+    for (const string& response : responses) {
+      map<string, JsonValue> fields = parseJsonObject(response);
+      ASSERT_TRUE(fields.count("latency_us")) << response;
+      if (fields["id"].text == "null") {
+        ASSERT_THAT(fields["ok"].text, Eq("false"));
+        ASSERT_THAT(fields["error"].text, Eq("Expected a JSON object"));
+      } else if (fields["id"].isString) {
+        ASSERT_THAT(fields["id"].text, Eq("last"));
+      } else {
+        ASSERT_THAT(fields["text"].text, Eq("BCD"));
+        seen[stoi(fields["id"].text)] = true;
+      }
+    }
+    ASSERT_THAT(seen, ContainerEq(vector<bool>(200, true)));
+  }
+}
+
+TEST(Server_Stream, RejectsOverlongLine) {
+  string lines = "{\"id\": 1, \"op\": \"score\", \"text\": \"" +
+                 string(SERVER_MAX_LINE_BYTES, 'a') + "\"}\n" +
+                 "{\"id\": 2, \"op\": \"score\", \"text\": \"school\"}\n";
+
+  vector<string> responses = serve(lines, 1);
+
+  ASSERT_THAT(responses.size(), Eq(2u));
+  map<string, JsonValue> fields = parseJsonObject(responses[0]);
+  ASSERT_THAT(fields["ok"].text, Eq("false"));
+  ASSERT_THAT(fields["error"].text, HasSubstr("Request longer than"));
+  ASSERT_THAT(parseJsonObject(responses[1])["id"].text, Eq("2"));
+}
+
+TEST(Server_Stream, Metrics) {
+  // One worker answers in order, so the metrics see both requests
+  vector<string> responses = serve(
+      "{\"op\": \"score\", \"text\": \"school\"}\n"
+      "{\"op\": \"nope\", \"text\": \"\"}\n"
+      "{\"id\": \"m\", \"op\": \"metrics\"}\n",
+      1);
+
+  ASSERT_THAT(responses.size(), Eq(3u));
+  ASSERT_THAT(responses[2], StartsWith("{\"id\": \"m\", \"ok\": true"));
+  ASSERT_THAT(responses[2], HasSubstr("\"queue_full_waits\": 0"));
+  ASSERT_THAT(responses[2],
+              HasSubstr("\"score\": {\"requests\": 1, \"errors\": 0"));
+  ASSERT_THAT(responses[2],
+              HasSubstr("\"nope\": {\"requests\": 1, \"errors\": 1"));
+}
+
+}  // namespace
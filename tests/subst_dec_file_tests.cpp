@@ -13,6 +13,8 @@ using ::std::endl;
 using ::std::ifstream;
 using ::std::string;
 using ::std::stringstream;
+using ::testing::HasSubstr;
+using ::testing::Not;
 using ::testing::StrEq;
 
 class SubstDecFile_MainCommand : public CaptureCinCout {};
@@ -49,3 +51,18 @@ TEST_F(SubstDecFile_MainCommand, FireIce) {
 
   ASSERT_THAT(ss_actual.str(), StrEq(ss_expected.str()));
 }
+
+TEST_F(SubstDecFile_MainCommand, MissingInput) {
+  string output_file = "actual_missing.txt";
+  input << "f" << endl;
+  input << "test_data/missing.txt" << endl;
+  input << output_file << endl;
+  input << "x" << endl;
+
+  ciphers_main();
+
+  // Stops before solving, so the write is never tried
+  ASSERT_THAT(output.str(), HasSubstr("Couldn't read test_data/missing.txt\n"));
+  ASSERT_THAT(output.str(), Not(HasSubstr(" or write ")));
+  ASSERT_FALSE(std::filesystem::exists(output_file));
+}
@@ -1,16 +1,28 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
 
+#include "include/caesar_dec.h"
+#include "include/rng.h"
 #include "include/subst_dec.h"
+#include "include/subst_enc.h"
 #include "tests/test_utils.h"
 #include "utils.h"
 
+using ::testing::ContainerEq;
 using ::testing::DoubleEq;
+using ::testing::DoubleNear;
+using ::testing::ElementsAreArray;
+using ::testing::Eq;
 using ::testing::HasSubstr;
+using ::testing::TestParamInfo;
+using ::testing::TestWithParam;
 using ::testing::Values;
 using ::testing::WithParamInterface;
 
@@ -48,6 +60,686 @@ TEST(SubstDec_ScoreString, LongerWord) {
       << "Incorrect score for even longer string";
 }
 
+TEST(SubstDec_ScoreIndices, MatchesScoreString) {
+  ASSERT_THAT(scoreIndices(CUSTOM_QUADGRAM_SCORER, cleanToIndices("SCHOOLS")),
+              DoubleEq(scoreString(CUSTOM_QUADGRAM_SCORER, "SCHOOLS")));
+  ASSERT_THAT(scoreIndices(CUSTOM_QUADGRAM_SCORER, cleanToIndices("POOL")),
+              DoubleEq(scoreString(CUSTOM_QUADGRAM_SCORER, "POOL")));
+  ASSERT_THAT(scoreIndices(CUSTOM_QUADGRAM_SCORER, cleanToIndices("SCH")),
+              DoubleEq(0))
+      << "Text without any quadgrams should score 0";
+}
+
+TEST(SubstDec_IncrementalScorer, MatchesFullRescore) {
+  const string ciphertext = "SCHOOLSPOOLSIDEBYTHESCHOOLSIDE";
+  vector<char> key = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I',
+                      'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R',
+                      'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z'};
+  QuadgramTerms terms(cleanToIndices(ciphertext));
+  IncrementalScorer state(CUSTOM_QUADGRAM_SCORER, terms, toSubstKey(key));
+
+  ASSERT_THAT(state.getScore(),
+              DoubleEq(scoreString(CUSTOM_QUADGRAM_SCORER, ciphertext)));
+
+  vector<pair<int, int>> swaps = {{2, 7}, {14, 18}, {0, 25}, {3, 11}};
+  for (auto [letter1, letter2] : swaps) {
+    swap(key[letter1], key[letter2]);
+    double expected =
+        scoreString(CUSTOM_QUADGRAM_SCORER, applySubstCipher(key, ciphertext));
+
+    ASSERT_THAT(state.trySwap(letter1, letter2), DoubleNear(expected, 1e-9))
+        << "Incorrect score after swapping " << letter1 << " and " << letter2;
+    state.commit();
+    ASSERT_THAT(fromSubstKey(state.getKey()), ContainerEq(key));
+  }
+}
+
+TEST(SubstDec_IncrementalScorer, Histogram) {
+  const string ciphertext = "SCHOOLSCHOOLSCHOOLSCHOOLSCHOOLSCHOOL";
+  vector<char> key = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I',
+                      'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R',
+                      'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z'};
+  QuadgramTerms positions(cleanToIndices(ciphertext), ScoringMode::Positions);
+  QuadgramTerms histogram(cleanToIndices(ciphertext), ScoringMode::Histogram);
+  QuadgramTerms automatic(cleanToIndices(ciphertext));
+
+  ASSERT_FALSE(positions.isHistogram());
+  ASSERT_THAT(positions.size(), Eq(ciphertext.size() - 3));
+  ASSERT_TRUE(histogram.isHistogram());
+  ASSERT_THAT(histogram.size(), Eq(6)) << "SCHOOL repeats 6 distinct quadgrams";
+  ASSERT_TRUE(automatic.isHistogram())
+      << "Repetitive text should pick the histogram automatically";
+
+  IncrementalScorer state(CUSTOM_QUADGRAM_SCORER, histogram, toSubstKey(key));
+  ASSERT_THAT(state.getScore(),
+              DoubleNear(scoreString(CUSTOM_QUADGRAM_SCORER, ciphertext), 1e-9));
+
+  swap(key[2], key[14]);
+  ASSERT_THAT(state.trySwap(2, 14),
+              DoubleNear(scoreString(CUSTOM_QUADGRAM_SCORER,
+                                     applySubstCipher(key, ciphertext)),
+                         1e-9));
+}
+
+TEST(SubstDec_IncrementalScorer, Rollback) {
+  const string ciphertext = "POOLSIDESCHOOLS";
+  vector<char> key = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I',
+                      'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R',
+                      'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z'};
+  QuadgramTerms terms(cleanToIndices(ciphertext));
+  IncrementalScorer state(CUSTOM_QUADGRAM_SCORER, terms, toSubstKey(key));
+  double before = state.getScore();
+
+  state.trySwap(14, 18);
+  state.rollback();
+
+  ASSERT_THAT(state.getScore(), DoubleEq(before));
+  ASSERT_THAT(fromSubstKey(state.getKey()), ContainerEq(key));
+  ASSERT_THAT(state.trySwap(0, 1), DoubleEq(before))
+      << "Swapping letters that don't appear shouldn't change the score";
+}
+
+TEST(SubstDec_FrequencyKey, RanksByCount) {
+  SubstKey key = frequencyKey(cleanToIndices("ZZZZ YYY XX W"));
+  vector<char> cipher = fromSubstKey(key);
+
+  ASSERT_THAT(cipher['Z' - 'A'], Eq('E'));
+  ASSERT_THAT(cipher['Y' - 'A'], Eq('T'));
+  ASSERT_THAT(cipher['X' - 'A'], Eq('A'));
+  ASSERT_THAT(cipher['W' - 'A'], Eq('O'));
+  // Unused letters keep alphabetical order for the rest
+  ASSERT_THAT(cipher['A' - 'A'], Eq('I'));
+  ASSERT_THAT(cipher['V' - 'A'], Eq('Z'));
+}
+
+const auto ENGINES = Values(SolverEngine::HillClimb, SolverEngine::Anneal,
+                            SolverEngine::BestSwap, SolverEngine::FirstSwap);
+
+string engineName(const TestParamInfo<SolverEngine>& info) {
+  switch (info.param) {
+    case SolverEngine::Anneal:
+      return "Anneal";
+    case SolverEngine::BestSwap:
+      return "BestSwap";
+    case SolverEngine::FirstSwap:
+      return "FirstSwap";
+    default:
+      return "HillClimb";
+  }
+}
+
+class SubstDec_SolverEngine : public TestWithParam<SolverEngine> {};
+
+TEST_P(SubstDec_SolverEngine, SameKeyForAnyThreadCount) {
+  vector<uint8_t> ciphertext = cleanToIndices("SCHOOLS POOLSIDE SCHOOLS");
+  SolverOptions options;
+  options.engine = GetParam();
+  options.restarts = 6;
+
+  Random::seed(7);
+  SubstKey serial = solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options);
+
+  for (int threads : {2, 3, 8}) {
+    options.threads = threads;
+    Random::seed(7);
+    ASSERT_THAT(solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options),
+                ContainerEq(serial))
+        << "Different key with " << threads << " threads";
+  }
+}
+
+TEST_P(SubstDec_SolverEngine, ScoreCacheKeepsKey) {
+  ifstream file("test_data/fire_ice_enc.txt");
+  stringstream text;
+  text << file.rdbuf();
+  vector<uint8_t> ciphertext = cleanToIndices(text.str());
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  SolverOptions options;
+  options.engine = GetParam();
+  options.restarts = 6;
+  options.annealIterations = 2000;
+
+  options.scoreCacheBits = 0;
+  solverStats().reset();
+  Random::seed(7);
+  SubstKey uncached = solveSubstKey(scorer, ciphertext, options);
+  RestartCounters plain = solverStats().totals;
+  ASSERT_EQ(plain.cacheLookups, 0u);
+
+  for (int threads : {1, 3}) {
+    options.scoreCacheBits = 12;
+    options.threads = threads;
+    solverStats().reset();
+    Random::seed(7);
+    ASSERT_THAT(solveSubstKey(scorer, ciphertext, options),
+                ContainerEq(uncached))
+        << "Different key with " << threads << " threads";
+
+    // Same swaps, with the ones turned down on a cached score left unscored
+    const RestartCounters& cached = solverStats().totals;
+    ASSERT_EQ(cached.swapsProposed, plain.swapsProposed);
+    ASSERT_EQ(cached.swapsAccepted, plain.swapsAccepted);
+    if (options.engine == SolverEngine::HillClimb) {
+      ASSERT_GT(cached.cacheHits, 0u);
+      ASSERT_LT(cached.quadgramsScored, plain.quadgramsScored);
+    } else {
+      ASSERT_EQ(cached.cacheLookups, 0u);
+    }
+  }
+}
+
+TEST(SubstDec_ScoreCache, FindsStoredScores) {
+  ScoreCache cache(4);
+  ASSERT_EQ(cache.size(), 16u);
+
+  SubstKey key = toSubstKey(genRandomSubstCipher());
+  uint64_t hash = ScoreCache::hash(key);
+  double score;
+  ASSERT_FALSE(cache.find(hash, score));
+  cache.store(hash, -123.25);
+  ASSERT_TRUE(cache.find(hash, score));
+  ASSERT_THAT(score, Eq(-123.25));
+
+  // A swap's hash is the swapped key's hash, and lands it elsewhere
+  SubstKey swapped = key;
+  swap(swapped[3], swapped[17]);
+  uint64_t swappedHash = hash ^ ScoreCache::swapHash(key, 3, 17);
+  ASSERT_EQ(swappedHash, ScoreCache::hash(swapped));
+  ASSERT_FALSE(cache.find(swappedHash, score));
+
+  // A new score takes over the slot
+  cache.store(hash ^ 16, -1);
+  ASSERT_TRUE(cache.find(hash ^ 16, score));
+  ASSERT_FALSE(cache.find(hash, score));
+
+  ASSERT_THROW(ScoreCache(0), invalid_argument);
+  ASSERT_THROW(ScoreCache(31), invalid_argument);
+}
+
+// Most of this scorer's quadgrams are equally unlikely, so hill climbing gets
+// stuck on the plateau; annealing should wander off it
+TEST(SubstDec_Anneal, FindsKnownQuadgrams) {
+  const string plaintext = "SCHOOLSCHOOLSCHOOLS";
+  vector<char> cipher = {'V', 'Y', 'B', 'L', 'Z', 'O', 'F', 'M', 'A',
+                         'I', 'D', 'Q', 'G', 'J', 'K', 'X', 'H', 'N',
+                         'W', 'E', 'R', 'S', 'U', 'P', 'C', 'T'};
+  vector<uint8_t> ciphertext =
+      cleanToIndices(applySubstCipher(cipher, plaintext));
+  SolverOptions options;
+  options.engine = SolverEngine::Anneal;
+  options.restarts = 16;
+
+  Random::seed(0);
+  SubstKey key = solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options);
+
+  applySubstKey(key, ciphertext.data(), ciphertext.data(), ciphertext.size());
+  ASSERT_THAT(ciphertext, ContainerEq(cleanToIndices(plaintext)));
+}
+
+TEST(SubstDec_Sweep, StopsAtLocalOptimum) {
+  ifstream file("test_data/fire_ice_enc.txt");
+  stringstream text;
+  text << file.rdbuf();
+  vector<uint8_t> ciphertext = cleanToIndices(text.str());
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  QuadgramTerms terms(ciphertext);
+
+  for (SolverEngine engine : {SolverEngine::BestSwap, SolverEngine::FirstSwap}) {
+    SolverOptions options;
+    options.engine = engine;
+    RestartResult result =
+        solveSubstRestart(scorer, ciphertext, terms, 7, 0, options);
+
+    // The last sweep tried every swap and kept none
+    ASSERT_GE(result.counters.swapsProposed, 300u);
+    for (int letter1 = 0; letter1 < 26; letter1++) {
+      for (int letter2 = letter1 + 1; letter2 < 26; letter2++) {
+        SubstKey swapped = result.key;
+        swap(swapped[letter1], swapped[letter2]);
+        ASSERT_LE(terms.score(scorer, swapped), result.score + 1e-9)
+            << "Swapping " << letter1 << " and " << letter2;
+      }
+    }
+
+    // Nothing but the starting key is random, and a warm start's first
+    // restart doesn't draw one
+    options.warmStart = true;
+    ASSERT_THAT(solveSubstRestart(scorer, ciphertext, terms, 7, 0, options).key,
+                ContainerEq(solveSubstRestart(scorer, ciphertext, terms, 8, 0,
+                                              options)
+                                .key));
+  }
+}
+
+TEST(SubstDec_Sample, EvenlySpacedSpans) {
+  vector<uint8_t> ciphertext(100);
+  for (size_t i = 0; i < ciphertext.size(); i++) {
+    ciphertext[i] = i;
+  }
+
+  // 8 spans of 2, starting every (100 - 2) / 7 = 14 letters
+  ASSERT_THAT(sampleCiphertext(ciphertext, 16),
+              ElementsAreArray({0, 1, 14, 15, 28, 29, 42, 43, 56, 57, 70, 71,
+                                84, 85, 98, 99}));
+  ASSERT_THAT(sampleCiphertext(ciphertext, 100), ContainerEq(ciphertext));
+}
+
+TEST(SubstDec_Sample, SolvesFullText) {
+  ifstream file("plaintext.txt");
+  ASSERT_TRUE(file.good()) << "Are you running this from the correct directory?";
+  stringstream plaintext;
+  plaintext << file.rdbuf();
+
+  vector<char> cipher = {'V', 'Y', 'B', 'L', 'Z', 'O', 'F', 'M', 'A',
+                         'I', 'D', 'Q', 'G', 'J', 'K', 'X', 'H', 'N',
+                         'W', 'E', 'R', 'S', 'U', 'P', 'C', 'T'};
+  vector<uint8_t> ciphertext =
+      cleanToIndices(applySubstCipher(cipher, plaintext.str()));
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  SolverOptions options;
+  options.restarts = 8;
+  options.sampleLetters = 2000;
+
+  Random::seed(0);
+  SubstKey key = solveSubstKey(scorer, ciphertext, options);
+
+  applySubstKey(key, ciphertext.data(), ciphertext.data(), ciphertext.size());
+  ASSERT_THAT(ciphertext, ContainerEq(cleanToIndices(plaintext.str())));
+}
+
+TEST(SubstDec_Sample, BudgetsCoverFullText) {
+  ifstream file("plaintext.txt");
+  stringstream plaintext;
+  plaintext << file.rdbuf();
+  string text;
+  for (int i = 0; i < 20; i++) {
+    text += plaintext.str();
+  }
+  vector<uint8_t> ciphertext =
+      cleanToIndices(applySubstCipher(genRandomSubstCipher(), text));
+  QuadgramScorer scorer("english_quadgrams.bin", "english_quadgrams.txt");
+  SolverOptions options;
+  options.restarts = 1000;
+  options.sampleLetters = 2000;
+
+  // The sample's restarts stop in time to leave some for the full text
+  options.timeLimit = 0.3;
+  solverStats().reset();
+  Random::seed(3);
+  auto start = chrono::steady_clock::now();
+  solveSubstKey(scorer, ciphertext, options);
+  double seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  ASSERT_LT(seconds, options.timeLimit + 0.2);
+  ASSERT_LT(solverStats().restarts, 1000u);
+
+  // The sample and the full text share one swap budget
+  options.timeLimit = 0;
+  options.swapLimit = 3000;
+  solverStats().reset();
+  Random::seed(3);
+  solveSubstKey(scorer, ciphertext, options);
+  ASSERT_LT(solverStats().totals.swapsProposed, 2 * options.swapLimit);
+}
+
+// Keys found with mt19937 before the generator became selectable
+TEST(SubstDec_Rng, Mt19937KeepsOriginalKeys) {
+  vector<uint8_t> ciphertext = cleanToIndices("SCHOOLS POOLSIDE SCHOOLS");
+  SolverOptions options;
+  options.rng = RngEngine::Mt19937;
+  options.restarts = 6;
+
+  Random::seed(7);
+  ASSERT_THAT(fromSubstKey(solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext,
+                                         options)),
+              ElementsAreArray("YFTGOVILADHQBUZJCXWESPRKNM", 26));
+
+  options.engine = SolverEngine::Anneal;
+  Random::seed(7);
+  ASSERT_THAT(fromSubstKey(solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext,
+                                         options)),
+              ElementsAreArray("NBCYTDFHJPXLRGOUVWSIEZQKAM", 26));
+}
+
+// Known-answer tests from the Random123 distribution
+TEST(SubstDec_Rng, PhiloxKnownAnswers) {
+  ASSERT_THAT(Philox::generate({0, 0, 0, 0}, {0, 0}),
+              ElementsAreArray({0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu,
+                                0x9b00dbd8u}));
+  ASSERT_THAT(Philox::generate({0x243f6a88, 0x85a308d3, 0x13198a2e,
+                                0x03707344},
+                               {0xa4093822, 0x299f31d0}),
+              ElementsAreArray({0xd16cfe09u, 0x94fdccebu, 0x5001e420u,
+                                0x24126ea1u}));
+
+  // Stream (seed, job, restart) is block counter 0, 1, ... with the restart
+  // in the third word
+  Philox rng(0xa4093822, 0x299f31d0, 0x13198a2e);
+  array<uint32_t, 4> first = Philox::generate({0, 0, 0x13198a2e, 0},
+                                              {0xa4093822, 0x299f31d0});
+  for (uint32_t word : first) {
+    ASSERT_EQ(rng(), word);
+  }
+  ASSERT_EQ(rng(), Philox::generate({1, 0, 0x13198a2e, 0},
+                                    {0xa4093822, 0x299f31d0})[0]);
+}
+
+TEST(SubstDec_BestRestart, VeryNegativeScores) {
+  // A book-length text scores far below -1e9
+  const string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  vector<RestartResult> results(3);
+  results[0].key = toSubstKey(vector<char>(alphabet.rbegin(), alphabet.rend()));
+  results[0].score = -4e12;
+  results[1].key = toSubstKey(vector<char>(alphabet.begin(), alphabet.end()));
+  results[1].score = -3e12;
+  results[2].key = results[0].key;
+  results[2].score = -3e12;
+
+  ASSERT_THAT(bestRestart(results), ContainerEq(results[1].key));
+  ASSERT_THAT(bestRestart({results[0]}), ContainerEq(results[0].key));
+}
+
+TEST(SubstDec_Rng, RestartsInAnyOrder) {
+  vector<uint8_t> ciphertext = cleanToIndices("SCHOOLS POOLSIDE SCHOOLS");
+  QuadgramTerms terms(ciphertext);
+  SolverOptions options;
+  options.restarts = 6;
+  options.job = 3;
+
+  Random::seed(7);
+  SubstKey expected =
+      solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options);
+  Random::seed(7);
+  uint32_t seed = Random::drawSeed();
+
+  // As if each restart ran on a different machine, last one first
+  vector<RestartResult> results(restartCount(options));
+  for (int i = results.size() - 1; i >= 0; i--) {
+    results[i] = solveSubstRestart(CUSTOM_QUADGRAM_SCORER, ciphertext, terms,
+                                   seed, i, options);
+  }
+  ASSERT_THAT(bestRestart(results), ContainerEq(expected));
+  ASSERT_THAT(solveSubstRestart(CUSTOM_QUADGRAM_SCORER, ciphertext, terms,
+                                seed, 2, options)
+                  .score,
+              DoubleEq(results[2].score));
+}
+
+TEST(SubstDec_Rng, BoundedIntsAreUniform) {
+  Xoshiro256 rng(1);
+  int counts[26] = {0};
+  for (int i = 0; i < 26000; i++) {
+    int value = Random::randInt(rng, 25);
+    ASSERT_GE(value, 0);
+    ASSERT_LE(value, 25);
+    counts[value]++;
+  }
+  for (int count : counts) {
+    ASSERT_NEAR(count, 1000, 150);
+  }
+}
+
+class SubstDec_Budget : public TestWithParam<SolverEngine> {};
+
+TEST_P(SubstDec_Budget, AgreeStopsEarly) {
+  vector<uint8_t> ciphertext = cleanToIndices("SCHOOLS POOLSIDE SCHOOLS");
+  SolverOptions options;
+  options.engine = GetParam();
+  options.restarts = 25;
+  options.agreeRestarts = 2;
+
+  solverStats().reset();
+  Random::seed(7);
+  SubstKey serial = solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options);
+  uint64_t restarts = solverStats().restarts;
+  ASSERT_LT(restarts, 25u);
+
+  // The best score so far was reached twice, by the last restart and one
+  // before it
+  const vector<double>& scores = solverStats().restartScores;
+  double best = *max_element(scores.begin(), scores.end());
+  ASSERT_THAT(scores.back(), DoubleEq(best));
+  ASSERT_THAT(count(scores.begin(), scores.end(), best), Eq(2));
+
+  for (int threads : {2, 3, 8}) {
+    options.threads = threads;
+    solverStats().reset();
+    Random::seed(7);
+    ASSERT_THAT(solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options),
+                ContainerEq(serial))
+        << "Different key with " << threads << " threads";
+    ASSERT_EQ(solverStats().restarts, restarts);
+  }
+}
+
+TEST_P(SubstDec_Budget, SwapLimit) {
+  vector<uint8_t> ciphertext = cleanToIndices("SCHOOLS POOLSIDE SCHOOLS");
+  SolverOptions options;
+  options.engine = GetParam();
+  options.restarts = 25;
+  options.annealIterations = 2000;
+  options.swapLimit = 3000;
+
+  solverStats().reset();
+  Random::seed(7);
+  SubstKey serial = solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options);
+  uint64_t swaps = solverStats().totals.swapsProposed;
+  ASSERT_GE(swaps, 3000u);
+  ASSERT_LT(swaps, 6000u);
+  ASSERT_LT(solverStats().restarts, 25u);
+
+  options.threads = 3;
+  solverStats().reset();
+  Random::seed(7);
+  ASSERT_THAT(solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options),
+              ContainerEq(serial));
+  ASSERT_EQ(solverStats().totals.swapsProposed, swaps);
+}
+
+TEST_P(SubstDec_Budget, TimeLimitKeepsFirstRestart) {
+  vector<uint8_t> ciphertext = cleanToIndices("SCHOOLS POOLSIDE SCHOOLS");
+  SolverOptions options;
+  options.engine = GetParam();
+  options.timeLimit = 1e-9;
+
+  solverStats().reset();
+  solveSubstKey(CUSTOM_QUADGRAM_SCORER, ciphertext, options);
+  ASSERT_EQ(solverStats().restarts, 1u);
+  ASSERT_EQ(solverStats().totals.swapsProposed, 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(, SubstDec_Budget, ENGINES, engineName);
+
+TEST(SubstDec_Stats, CountsEveryRestart) {
+  SolverOptions options;
+  options.restarts = 6;
+
+  Random::seed(7);
+  decryptSubstCipher(CUSTOM_QUADGRAM_SCORER, "SCHOOLS POOLSIDE SCHOOLS",
+                     options);
+
+  const SolverStats& stats = solverStats();
+  ASSERT_EQ(stats.restarts, 6u);
+  ASSERT_THAT(stats.restartScores.size(), Eq(6u));
+  ASSERT_GT(stats.totals.swapsProposed, 0u);
+  ASSERT_LE(stats.totals.swapsAccepted, stats.totals.swapsProposed);
+  // Every restart scores all 18 quadgrams at least once
+  ASSERT_GE(stats.totals.quadgramsScored, 6u * 18);
+
+  // A second decryption starts from zero
+  Random::seed(7);
+  decryptSubstCipher(CUSTOM_QUADGRAM_SCORER, "SCHOOLS POOLSIDE SCHOOLS",
+                     options);
+  ASSERT_EQ(solverStats().restarts, 6u);
+}
+
+TEST(SubstDec_Stats, Json) {
+  SolverStats stats;
+  stats.addRestart({10, 4, 100}, -12.5);
+  stats.addRestart({20, 6, 200}, -10);
+
+  ASSERT_THAT(stats.toJson(),
+              Eq("{\"restarts\": 2, \"swaps_proposed\": 30, "
+                 "\"swaps_accepted\": 10, \"quadgrams_scored\": 300, "
+                 "\"cache_lookups\": 0, \"cache_hits\": 0, "
+                 "\"restart_scores\": [-12.5, -10], \"seconds\": {\"load\": 0, "
+                 "\"clean\": 0, \"climb\": 0, \"apply\": 0}}"));
+}
+
+class SubstDec_StatsCommand : public CaptureCinCout {};
+
+TEST_F(SubstDec_StatsCommand, Main) {
+  SolverOptions options;
+  options.restarts = 3;
+  Random::seed(7);
+  decryptSubstCipher(CUSTOM_QUADGRAM_SCORER, "SCHOOLS POOLSIDE SCHOOLS",
+                     options);
+
+  printSolverStatsCommand();
+
+  string actual_output = output.str();
+  output.clear();
+
+  ASSERT_THAT(actual_output, HasSubstr("Restarts: 3"));
+  ASSERT_THAT(actual_output, HasSubstr("Swaps proposed: "));
+}
+
+class SubstDec_OptionsMainCommand : public CaptureCinCout {};
+
+TEST_F(SubstDec_OptionsMainCommand, RejectsBadScoreCache) {
+  char program[] = "ciphers_main";
+  for (string flag : {"--score-cache=31", "--score-cache=-1",
+                      "--score-cache=99999999999999", "--agree=many"}) {
+    char* argv[] = {program, flag.data(), nullptr};
+    ASSERT_THAT(ciphers_main(2, argv), Eq(1)) << flag;
+  }
+  // Rejected before the menu, not by the first solve
+  ASSERT_THAT(output.str(), Eq(""));
+}
+
+INSTANTIATE_TEST_SUITE_P(, SubstDec_SolverEngine, ENGINES, engineName);
+
+TEST(SubstDec_BinaryTable, RoundTrip) {
+  const string path = "test_quadgrams.bin";
+  ASSERT_TRUE(CUSTOM_QUADGRAM_SCORER.save(path));
+
+  QuadgramScorer loaded(path, "missing_quadgrams.txt");
+  std::filesystem::remove(path);
+
+  ASSERT_TRUE(loaded.isMapped()) << "Precompiled table wasn't mapped";
+  for (const string s : {"AAAA", "ABCD", "SCHOOLS", "POOLSIDE"}) {
+    ASSERT_THAT(scoreString(loaded, s),
+                DoubleEq(scoreString(CUSTOM_QUADGRAM_SCORER, s)))
+        << "Incorrect score for " << s << " from precompiled table";
+  }
+}
+
+TEST(SubstDec_BinaryTable, FallsBackToCsv) {
+  const string binaryPath = "test_quadgrams.bin";
+  const string csvPath = "test_quadgrams.txt";
+  ofstream(binaryPath) << "not a quadgram table";
+  ofstream(csvPath) << "ABCD,1408\nSCHO,1202417\nCHOO,1140139\n"
+                    << "HOOL,104875\nOOLS,345451\n";
+
+  QuadgramScorer loaded(binaryPath, csvPath);
+  std::filesystem::remove(binaryPath);
+  std::filesystem::remove(csvPath);
+
+  ASSERT_FALSE(loaded.isMapped()) << "Invalid precompiled table was mapped";
+  ASSERT_THAT(scoreString(loaded, "SCHOOLS"),
+              DoubleEq(scoreString(CUSTOM_QUADGRAM_SCORER, "SCHOOLS")));
+}
+
+class SubstDec_TableFormat
+    : public TestWithParam<tuple<TableFormat, double, string>> {};
+
+TEST_P(SubstDec_TableFormat, CloseToDouble) {
+  auto& param = GetParam();
+  auto format = get<0>(param);
+  auto tolerancePerQuadgram = get<1>(param);
+
+  QuadgramScorer scorer({"ABCD", "SCHO", "CHOO", "HOOL", "OOLS"},
+                        {1408, 1202417, 1140139, 104875, 345451});
+  scorer.setFormat(format);
+  ASSERT_THAT(scorer.getFormat(), Eq(format));
+
+  for (const string s : {"AAAA", "ABCD", "SCHOOLS", "POOLSIDE"}) {
+    double expected = scoreString(CUSTOM_QUADGRAM_SCORER, s);
+    ASSERT_THAT(scoreString(scorer, s),
+                DoubleNear(expected, tolerancePerQuadgram * (s.size() - 3)))
+        << "Score for " << s << " drifted too far";
+    ASSERT_THAT(scorer.getScore(s.substr(0, 4)),
+                DoubleNear(CUSTOM_QUADGRAM_SCORER.getScore(s.substr(0, 4)),
+                           tolerancePerQuadgram));
+  }
+}
+
+// The score of `ciphertext` under `key` as the solver tracks it on the
+// scorer's `T` table, after swapping 2 and 14 and back
+template <class T>
+double incrementalScore(const QuadgramScorer& scorer, const string& ciphertext,
+                        const SubstKey& key) {
+  QuadgramTerms terms(cleanToIndices(ciphertext));
+  IncrementalScorer<QuadgramTable<T>> state(scorer, terms, key);
+  auto before = state.getScore();
+  state.trySwap(2, 14);
+  state.commit();
+  state.trySwap(2, 14);
+  state.commit();
+  // Fixed-point sums are integers, so they come back exactly
+  if (is_integral_v<T>) {
+    EXPECT_EQ(state.getScore(), before);
+  }
+  return state.getTable().toScore(state.getScore(), ciphertext.size() - 3);
+}
+
+TEST_P(SubstDec_TableFormat, IncrementalScorerReadsFormat) {
+  auto& param = GetParam();
+  auto format = get<0>(param);
+  auto tolerancePerQuadgram = get<1>(param);
+
+  QuadgramScorer scorer({"ABCD", "SCHO", "CHOO", "HOOL", "OOLS"},
+                        {1408, 1202417, 1140139, 104875, 345451});
+  scorer.setFormat(format);
+  static_assert(
+      is_same_v<IncrementalScorer<QuadgramTable<int16_t>>::Sum, int64_t>);
+
+  const string ciphertext = "POOLSIDESCHOOLS";
+  SubstKey key = toSubstKey(genRandomSubstCipher());
+  double expected = scoreString(CUSTOM_QUADGRAM_SCORER,
+                                applySubstCipher(fromSubstKey(key), ciphertext));
+  double actual = 0;
+  switch (format) {
+    case TableFormat::Float:
+      actual = incrementalScore<float>(scorer, ciphertext, key);
+      break;
+    case TableFormat::Int16:
+      actual = incrementalScore<int16_t>(scorer, ciphertext, key);
+      break;
+    case TableFormat::Uint8:
+      actual = incrementalScore<uint8_t>(scorer, ciphertext, key);
+      break;
+    default:
+      actual = incrementalScore<double>(scorer, ciphertext, key);
+      // Only a scorer set to a format has its table
+      ASSERT_THROW(QuadgramTable<float>{scorer}, invalid_argument);
+  }
+  ASSERT_THAT(actual, DoubleNear(expected, tolerancePerQuadgram *
+                                               (ciphertext.size() - 3) +
+                                           1e-9));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    , SubstDec_TableFormat,
+    // Format, maximum error per quadgram
+    Values(make_tuple(TableFormat::Double, 0.0, "Double"),
+           make_tuple(TableFormat::Float, 1e-6, "Float"),
+           make_tuple(TableFormat::Int16, 1e-4, "Int16"),
+           make_tuple(TableFormat::Uint8, 0.01, "Uint8")),
+    [](const TestParamInfo<SubstDec_TableFormat::ParamType>& info) {
+      return last_elem(info.param);
+    });
+
 class SubstDec_EnglishnessFuncCommand : public CaptureCinCout {};
 
 TEST_F(SubstDec_EnglishnessFuncCommand, Main) {
@@ -1,12 +1,16 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 
 #include "include/subst_enc.h"
 #include "tests/test_utils.h"
 
+using ::testing::ElementsAreArray;
 using ::testing::HasSubstr;
 using ::testing::StrEq;
 
@@ -41,6 +45,89 @@ TEST(SubstEnc_ApplyCipher, Cipher) {
               StrEq("GN. IKBD, ES HRAT XML, YVFW OZU QCJP."));
 }
 
+TEST(SubstEnc_ApplyKey, MatchesApplyCipher) {
+  vector<char> cipher = {'V', 'Y', 'B', 'L', 'Z', 'O', 'F', 'M', 'A',
+                         'I', 'D', 'Q', 'G', 'J', 'K', 'X', 'H', 'N',
+                         'W', 'E', 'R', 'S', 'U', 'P', 'C', 'T'};
+  SubstKey key = toSubstKey(cipher);
+
+  ASSERT_THAT(fromSubstKey(key), ElementsAreArray(cipher));
+  ASSERT_THAT(applySubstKey(key, MR_PANGRAM_PUNCT),
+              StrEq(applySubstCipher(cipher, MR_PANGRAM_PUNCT)));
+
+  vector<uint8_t> letters = {0, 1, 2, 25};
+  applySubstKey(key, letters.data(), letters.data(), letters.size());
+  ASSERT_THAT(letters, ElementsAreArray({'V' - 'A', 'Y' - 'A', 'B' - 'A',
+                                         'T' - 'A'}));
+}
+
+string readFile(const string& path) {
+  ifstream file(path);
+  stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+TEST(SubstEnc_ApplyKeyToFile, RoundTrip) {
+  vector<char> cipher = {'V', 'Y', 'B', 'L', 'Z', 'O', 'F', 'M', 'A',
+                         'I', 'D', 'Q', 'G', 'J', 'K', 'X', 'H', 'N',
+                         'W', 'E', 'R', 'S', 'U', 'P', 'C', 'T'};
+  SubstKey key = toSubstKey(cipher);
+  const string plain_file = "test_subst_plain.txt";
+  const string enc_file = "test_subst_enc.txt";
+  ofstream(plain_file) << MR_PANGRAM_PUNCT << "\n" << FOX_PANGRAM << "\n";
+
+  ASSERT_TRUE(applySubstKeyToFile(key, plain_file, enc_file));
+  ASSERT_THAT(readFile(enc_file),
+              StrEq(applySubstCipher(cipher, readFile(plain_file))));
+
+  ASSERT_TRUE(applySubstKeyToFile(invertSubstKey(key), enc_file, plain_file));
+  ASSERT_THAT(readFile(plain_file),
+              StrEq("MR. JOCK, TV QUIZ PHD, BAGS FEW LYNX.\n" + FOX_PANGRAM +
+                    "\n"));
+
+  std::filesystem::remove(plain_file);
+  std::filesystem::remove(enc_file);
+  ASSERT_FALSE(applySubstKeyToFile(key, plain_file, enc_file))
+      << "Missing input file should fail";
+  std::filesystem::remove(enc_file);
+}
+
+class SubstEnc_FileMainCommand : public CaptureCinCout {};
+
+TEST_F(SubstEnc_FileMainCommand, Decrypt) {
+  const string input_file = "test_subst_enc.txt";
+  const string output_file = "test_subst_plain.txt";
+  ofstream(input_file) << "EMZ HRABD YNKUJ OKP\n";
+
+  input << "k" << endl;
+  input << input_file << endl;
+  input << output_file << endl;
+  input << "VYBLZOFMAIDQGJKXHNWERSUPCT" << endl;
+  input << "d" << endl;
+  input << "x" << endl;
+
+  ciphers_main();
+
+  string actual = readFile(output_file);
+  std::filesystem::remove(input_file);
+  std::filesystem::remove(output_file);
+  ASSERT_THAT(actual, StrEq("THE QUICK BROWN FOX\n"));
+}
+
+TEST_F(SubstEnc_FileMainCommand, InvalidCipher) {
+  input << "k" << endl;
+  input << "unused_in.txt" << endl;
+  input << "unused_out.txt" << endl;
+  input << "ABC" << endl;
+  input << "x" << endl;
+
+  ciphers_main();
+
+  ASSERT_THAT(output.str(), HasSubstr("Invalid cipher"));
+  ASSERT_FALSE(std::filesystem::exists("unused_out.txt"));
+}
+
 class SubstEnc_RandCipherMainCommand : public CaptureCinCout {};
 
 TEST_F(SubstEnc_RandCipherMainCommand, FullCommand) {
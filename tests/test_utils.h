@@ -11,7 +11,14 @@
 
 // If we compile with GoogleTest's main, we'll need to store our own main
 // somewhere in order to invoke and test it.
-int ciphers_main();
+int ciphers_main(int argc, char* argv[]);
+
+// Most tests run main without any command line flags
+inline int ciphers_main() {
+  char program[] = "ciphers_main";
+  char* argv[] = {program, nullptr};
+  return ciphers_main(1, argv);
+}
 
 class CaptureCinCout : public testing::Test {
  protected: